@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "batcher.h"
+#include "bench.h"
+#include "mpmc_queue.h"
+
+#define BENCH_BATCH_FRAMES (1 << 16)
+#define BENCH_BATCH_QUEUE_SIZE 16
+
+namespace bench {
+// Stands in for Decode_vpp: stream threads hand out frames through the same queue,
+// the last one to finish appends the end of input
+class SyntheticFrameSource {
+   public:
+    explicit SyntheticFrameSource(int streams) : _running(streams) {
+        for (int s = 0; s < streams; s++) {
+            _threads.push_back(std::thread([=] {
+                for (size_t i = s; i < BENCH_BATCH_FRAMES; i += streams)
+                    _queue.push({&_surface, (size_t)s, i, 0, std::chrono::steady_clock::now(), 1080, 1920});
+                if (--_running == 0)
+                    _queue.push({NULL, (size_t)s, 0, 0, std::chrono::steady_clock::now(), 0, 0});
+            }));
+        }
+    }
+
+    ~SyntheticFrameSource() {
+        for (auto& thread : _threads)
+            thread.join();
+    }
+
+    bool read_until(DecodedFrame& frame, std::chrono::steady_clock::time_point deadline) {
+        if (_ended) {
+            frame = DecodedFrame();
+            return true;
+        }
+        bool ready = true;
+        if (deadline == std::chrono::steady_clock::time_point::max())
+            frame = _queue.pop();
+        else
+            ready = _queue.pop_until(frame, deadline);
+        if (ready && !frame.surface)
+            _ended = true;
+        return ready;
+    }
+
+   private:
+    multi_source::MpmcQueue<DecodedFrame> _queue{BENCH_BATCH_QUEUE_SIZE};
+    mfxFrameSurface1 _surface = {};  // never read, only marks a frame as valid
+    std::atomic<int> _running;
+    std::vector<std::thread> _threads;
+    bool _ended = false;
+};
+
+inline void RunBatchBenchmarks() {
+    const int stream_counts[] = {1, 8};
+    const size_t batch_sizes[] = {1, 8};
+    const int max_waits_us[] = {0, 1000};
+    for (int streams : stream_counts) {
+        for (size_t batch_size : batch_sizes) {
+            for (int max_wait_us : max_waits_us) {
+                std::string name = "batch/frame_batcher/streams=" + std::to_string(streams) +
+                                   "/bs=" + std::to_string(batch_size) + "/max_wait_us=" + std::to_string(max_wait_us);
+                size_t frames = 0;
+                Report(name, BestOf(3, [&] {
+                           SyntheticFrameSource source(streams);
+                           multi_source::FrameBatcher<SyntheticFrameSource> batcher(
+                               source, batch_size, std::chrono::microseconds(max_wait_us), false);
+                           std::vector<DecodedFrame> batch;
+                           frames = 0;
+                           while (batcher.next(batch, batch_size))
+                               frames += batch.size();
+                       }), BENCH_BATCH_FRAMES, "frames");
+                VERIFY(frames == BENCH_BATCH_FRAMES, "batch/frame_batcher: frames lost");
+            }
+        }
+    }
+}
+}  // namespace bench
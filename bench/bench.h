@@ -0,0 +1,82 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+namespace bench {
+// Run fn reps times and return the fastest run in milliseconds
+template <typename Fn>
+double BestOf(int reps, Fn fn) {
+    double best = 0;
+    for (int i = 0; i < reps; i++) {
+        auto t1 = std::chrono::high_resolution_clock::now();
+        fn();
+        auto t2 = std::chrono::high_resolution_clock::now();
+        double ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        best = (i == 0) ? ms : std::min(best, ms);
+    }
+    return best;
+}
+
+struct Result {
+    std::string name;
+    double ms;
+    double rate;  // items per second
+    std::string unit;
+};
+
+// Every reported result, for the JSON output
+inline std::vector<Result>& Results() {
+    static std::vector<Result> results;
+    return results;
+}
+
+// items is whatever the benchmark processes (bytes, frames, ...), unit names it
+inline void Report(const std::string& name, double ms, double items, const char* unit) {
+    double rate = items / (ms / 1000.0);
+    printf("%-40s %10.3f ms %14.1f %s/s\n", name.c_str(), ms, rate, unit);
+    Results().push_back({name, ms, rate, unit});
+}
+
+// Write the results as one JSON document, "-" writes to stdout
+inline bool WriteJson(const std::string& path) {
+    FILE* f = (path == "-") ? stdout : fopen(path.c_str(), "w");
+    if (!f)
+        return false;
+    fprintf(f, "{\"benchmarks\": [\n");
+    for (size_t i = 0; i < Results().size(); i++) {
+        const Result& r = Results()[i];
+        fprintf(f,
+                "  {\"name\": \"%s\", \"ms\": %.6f, \"rate\": %.3f, \"unit\": \"%s/s\"}%s\n",
+                r.name.c_str(),
+                r.ms,
+                r.rate,
+                r.unit.c_str(),
+                (i + 1 < Results().size()) ? "," : "");
+    }
+    fprintf(f, "]}\n");
+    if (f != stdout)
+        fclose(f);
+    return true;
+}
+
+// Cheap deterministic generator for synthetic inputs
+struct XorShift {
+    unsigned int state = 2463534242u;
+    unsigned int next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+};
+}  // namespace bench
@@ -0,0 +1,132 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <thread>
+#include "bench.h"
+#include "utils/bitstream_source.h"
+
+#define BENCH_BITSTREAM_FILE_SIZE (64 << 20)
+#define BENCH_BITSTREAM_WINDOW 2000000
+
+namespace bench {
+// Stand-in for the decoder: consume a frame-sized chunk and read every byte of it
+inline mfxU32 ConsumeFrame(mfxBitstream& bs, XorShift& rng, mfxU64& checksum) {
+    mfxU32 n = 1024 + rng.next() % (64 * 1024);
+    if (n > bs.DataLength)
+        n = bs.DataLength;
+    const mfxU8* p = bs.Data + bs.DataOffset;
+    mfxU32 sum = 0;
+    for (mfxU32 i = 0; i < n; i++)
+        sum += p[i];
+    checksum += sum;
+    bs.DataOffset += n;
+    bs.DataLength -= n;
+    return n;
+}
+
+inline std::string CreateSyntheticStream() {
+    char path[] = "/tmp/vpl_demo_bench_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0)
+        return std::string();
+    XorShift rng;
+    std::vector<unsigned int> chunk(1 << 18);
+    for (size_t written = 0; written < BENCH_BITSTREAM_FILE_SIZE; written += chunk.size() * sizeof(unsigned int)) {
+        for (auto& v : chunk)
+            v = rng.next();
+        if (write(fd, chunk.data(), chunk.size() * sizeof(unsigned int)) < 0)
+            break;
+    }
+    close(fd);
+    return path;
+}
+
+// Legacy path: fread into a calloc'd buffer compacted by ReadEncodedStream
+inline mfxU64 RunReadEncodedStream(const std::string& path) {
+    mfxU64 checksum = 0;
+    XorShift rng;
+    FILE* f = fopen(path.c_str(), "rb");
+    mfxBitstream bs = {};
+    bs.MaxLength = BENCH_BITSTREAM_WINDOW;
+    bs.Data = (mfxU8*)calloc(bs.MaxLength, sizeof(mfxU8));
+    while (ReadEncodedStream(bs, f) == MFX_ERR_NONE)
+        ConsumeFrame(bs, rng, checksum);
+    free(bs.Data);
+    fclose(f);
+    return checksum;
+}
+
+inline mfxU64 RunBitstreamSource(BitstreamSource* source) {
+    mfxU64 checksum = 0;
+    XorShift rng;
+    mfxBitstream bs = {};
+    while (source->Feed(bs) == MFX_ERR_NONE)
+        ConsumeFrame(bs, rng, checksum);
+    return checksum;
+}
+
+// A segment in the second half of a buffer read through a prefetch cursor. The first half is
+// PROT_NONE: a cursor faulting in bytes before the segment (or waiting for them) crashes here.
+// rebase starts the cursor at 0 and relies on require() skipping ahead to the first access.
+inline mfxU64 RunPrefetchSegment(Prefetcher& prefetcher, bool rebase) {
+    const size_t half = BENCH_BITSTREAM_FILE_SIZE / 2;
+    mfxU8* base = (mfxU8*)mmap(NULL, 2 * half, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED)
+        return 0;
+    for (size_t i = half; i < 2 * half; i += 4096)
+        base[i] = (mfxU8)(i >> 12);
+    mprotect(base, half, PROT_NONE);
+
+    mfxU64 checksum = 0;
+    {
+        std::shared_ptr<PrefetchCursor> cursor = prefetcher.track(base, 2 * half, nullptr, rebase ? 0 : half);
+        for (size_t pos = half; pos < 2 * half; pos += BENCH_BITSTREAM_WINDOW) {
+            size_t end = std::min(2 * half, pos + BENCH_BITSTREAM_WINDOW);
+            cursor->require(pos, end);
+            for (size_t i = pos; i < end; i += 4096)
+                checksum += base[i];
+        }
+        // the last read-ahead may still be running on the I/O thread
+        while (cursor.use_count() > 1)
+            std::this_thread::yield();
+    }
+    munmap(base, 2 * half);
+    return checksum;
+}
+
+inline void RunBitstreamBenchmarks() {
+    std::string path = CreateSyntheticStream();
+    if (path.empty()) {
+        printf("Not able to create synthetic bitstream\n");
+        return;
+    }
+    const double bytes = BENCH_BITSTREAM_FILE_SIZE;
+    mfxU64 expected = RunReadEncodedStream(path);
+    mfxU64 checksum = 0;
+
+    Report("bitstream/read_encoded_stream", BestOf(3, [&] { checksum = RunReadEncodedStream(path); }), bytes, "B");
+    Report("bitstream/mapped", BestOf(3, [&] {
+               std::unique_ptr<BitstreamSource> source = OpenBitstreamSource(path.c_str(), BENCH_BITSTREAM_WINDOW);
+               checksum = RunBitstreamSource(source.get());
+           }), bytes, "B");
+    VERIFY(checksum == expected, "bitstream/mapped: checksum mismatch");
+    Report("bitstream/ring", BestOf(3, [&] {
+               RingBitstreamSource source(open(path.c_str(), O_RDONLY), BENCH_BITSTREAM_WINDOW);
+               checksum = RunBitstreamSource(&source);
+           }), bytes, "B");
+    VERIFY(checksum == expected, "bitstream/ring: checksum mismatch");
+
+    Prefetcher prefetcher(2, 8 << 20);
+    mfxU64 segment = 0;
+    Report("bitstream/prefetch_segment", BestOf(3, [&] { segment = RunPrefetchSegment(prefetcher, false); }), bytes / 2, "B");
+    VERIFY(segment > 0, "bitstream/prefetch_segment: nothing read");
+    VERIFY(RunPrefetchSegment(prefetcher, true) == segment, "bitstream/prefetch_segment: checksum mismatch after a skip");
+
+    unlink(path.c_str());
+}
+}  // namespace bench
@@ -0,0 +1,94 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <sys/resource.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "schedule_bench.h"
+#include "utils/work_stealing_pool.h"
+
+#define BENCH_DECODE_STREAMS 128
+#define BENCH_DECODE_FRAMES 50      // decoded by every stream
+#define BENCH_DECODE_SUBMIT_US 20   // host time of read, decode and VPP submission per frame
+#define BENCH_DECODE_DEVICE_US 2000 // submission until the VPP output is synchronized
+
+namespace bench {
+// A stream of the simulated pipeline: host work per frame, then a device latency to wait out
+struct SimulatedStream {
+    size_t frames = 0;
+    bool pending = false;
+    std::chrono::steady_clock::time_point synced;  // the device is done with the pending frame
+};
+
+inline long ContextSwitches() {
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+// BENCH_DECODE_STREAMS streams decoded by one thread each blocking on sync (pool == false)
+// or as cooperative tasks of a WorkStealingPool with one worker per core
+inline void RunDecodeStreams(bool pool) {
+    size_t threads = pool ? std::max<size_t>(1, std::thread::hardware_concurrency()) : BENCH_DECODE_STREAMS;
+    long switches = 0;
+    Report(std::string("decode_pool/") + (pool ? "work_stealing" : "thread_per_stream") + "/streams=" +
+               std::to_string(BENCH_DECODE_STREAMS),
+           BestOf(1, [&] {
+               std::vector<SimulatedStream> streams(BENCH_DECODE_STREAMS);
+               long before = ContextSwitches();
+               if (!pool) {
+                   std::vector<std::thread> decoders;
+                   for (auto& stream : streams)
+                       decoders.emplace_back([&stream] {
+                           for (; stream.frames < BENCH_DECODE_FRAMES; stream.frames++) {
+                               SpinFor(std::chrono::microseconds(BENCH_DECODE_SUBMIT_US));
+                               std::this_thread::sleep_for(std::chrono::microseconds(BENCH_DECODE_DEVICE_US));
+                           }
+                       });
+                   for (auto& decoder : decoders)
+                       decoder.join();
+               } else {
+                   std::atomic<size_t> running(BENCH_DECODE_STREAMS);
+                   {
+                       WorkStealingPool<SimulatedStream> workers(threads, "bench worker", [&](SimulatedStream* s) {
+                           if (s->pending) {
+                               if (std::chrono::steady_clock::now() < s->synced)
+                                   return TASK_YIELD;
+                               s->pending = false;
+                               if (++s->frames == BENCH_DECODE_FRAMES) {
+                                   running--;
+                                   return TASK_DONE;
+                               }
+                           }
+                           SpinFor(std::chrono::microseconds(BENCH_DECODE_SUBMIT_US));
+                           s->pending = true;
+                           s->synced = std::chrono::steady_clock::now() + std::chrono::microseconds(BENCH_DECODE_DEVICE_US);
+                           return TASK_PROGRESS;
+                       });
+                       for (auto& stream : streams)
+                           workers.submit(&stream);
+                       while (running > 0)
+                           std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                   }
+               }
+               switches = ContextSwitches() - before;
+               for (auto& stream : streams)
+                   VERIFY(stream.frames == BENCH_DECODE_FRAMES, "decode_pool: frames lost");
+           }),
+           BENCH_DECODE_STREAMS * BENCH_DECODE_FRAMES,
+           "frames");
+    printf("  %zu threads, %ld context switches\n", threads, switches);
+}
+
+inline void RunDecodePoolBenchmarks() {
+    RunDecodeStreams(false);
+    RunDecodeStreams(true);
+}
+}  // namespace bench
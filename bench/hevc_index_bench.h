@@ -0,0 +1,181 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include "bench.h"
+#include "utils/hevc_index.h"
+
+#define BENCH_HEVC_GOPS 20000   // IDR sequences after the leading CRA
+#define BENCH_HEVC_PAYLOAD 64   // slice data bytes after the header
+#define BENCH_HEVC_SEGMENTS 3
+
+namespace bench {
+// RBSP writer for the few header fields the index parses
+class BitWriter {
+   public:
+    void u(mfxU32 value, int n) {
+        while (n--)
+            bit((value >> n) & 1);
+    }
+
+    void ue(mfxU32 value) {
+        int len = 0;
+        while ((value + 1) >> len)
+            len++;
+        u(0, len - 1);
+        u(value + 1, len);
+    }
+
+    // rbsp_trailing_bits, then payload bytes that never form a start code
+    std::vector<mfxU8> finish(size_t payload, XorShift& rng) {
+        bit(1);
+        while (_bits)
+            bit(0);
+        for (size_t i = 0; i < payload; i++)
+            _data.push_back((mfxU8)(rng.next() | 0x80));
+        return _data;
+    }
+
+   private:
+    void bit(mfxU32 b) {
+        _byte = (mfxU8)((_byte << 1) | b);
+        if (++_bits == 8) {
+            _data.push_back(_byte);
+            _byte = 0;
+            _bits = 0;
+        }
+    }
+
+    std::vector<mfxU8> _data;
+    mfxU8 _byte = 0;
+    int _bits = 0;
+};
+
+// Append a NAL unit with a 4-byte start code, emulation prevention bytes inserted
+inline void AppendNal(std::vector<mfxU8>& stream, mfxU8 type, const std::vector<mfxU8>& rbsp) {
+    const mfxU8 header[] = {0, 0, 0, 1, (mfxU8)(type << 1), 1};
+    stream.insert(stream.end(), header, header + sizeof(header));
+    int zeros = 0;
+    for (mfxU8 byte : rbsp) {
+        if (zeros >= 2 && byte <= 3) {
+            stream.push_back(3);
+            zeros = 0;
+        }
+        stream.push_back(byte);
+        zeros = byte ? 0 : zeros + 1;
+    }
+}
+
+// First slice segment of a picture, POC LSBs of 4 bits
+inline void AppendPicture(std::vector<mfxU8>& stream, mfxU8 type, mfxU32 poc_lsb, bool output, XorShift& rng) {
+    BitWriter w;
+    w.u(1, 1);  // first_slice_segment_in_pic_flag
+    if (type >= HEVC_NAL_BLA_W_LP && type <= HEVC_NAL_RSV_IRAP_23)
+        w.u(0, 1);  // no_output_of_prior_pics_flag
+    w.ue(0);        // slice_pic_parameter_set_id
+    w.ue(2);        // slice_type
+    w.u(output, 1);
+    if (type != HEVC_NAL_IDR_W_RADL && type != HEVC_NAL_IDR_N_LP)
+        w.u(poc_lsb, 4);
+    AppendNal(stream, type, w.finish(BENCH_HEVC_PAYLOAD, rng));
+}
+
+// A CRA starting the stream with two RASL pictures that are never output, then IDR sequences of
+// a RADL picture output before its IDR, two trailing pictures and one with pic_output_flag 0.
+// Output positions: CRA sequence 0-2, IDR sequence g at 3 + 4g.
+inline std::vector<mfxU8> CreateSyntheticHevc(size_t gops) {
+    const mfxU8 TRAIL_R = 1, RADL_R = 7, RASL_R = 9;
+    XorShift rng;
+    std::vector<mfxU8> stream;
+
+    BitWriter sps;
+    sps.u(0, 4);   // sps_video_parameter_set_id
+    sps.u(0, 3);   // sps_max_sub_layers_minus1
+    sps.u(1, 1);   // sps_temporal_id_nesting_flag
+    sps.u(0, 32);  // profile_tier_level
+    sps.u(0, 32);
+    sps.u(0, 32);
+    sps.ue(0);     // sps_seq_parameter_set_id
+    sps.ue(1);     // chroma_format_idc
+    sps.ue(64);    // pic_width_in_luma_samples
+    sps.ue(64);    // pic_height_in_luma_samples
+    sps.u(0, 1);   // conformance_window_flag
+    sps.ue(0);     // bit_depth_luma_minus8
+    sps.ue(0);     // bit_depth_chroma_minus8
+    sps.ue(0);     // log2_max_pic_order_cnt_lsb_minus4
+    AppendNal(stream, HEVC_NAL_SPS, sps.finish(0, rng));
+    BitWriter pps;
+    pps.ue(0);     // pps_pic_parameter_set_id
+    pps.ue(0);     // pps_seq_parameter_set_id
+    pps.u(0, 1);   // dependent_slice_segments_enabled_flag
+    pps.u(1, 1);   // output_flag_present_flag
+    pps.u(0, 3);   // num_extra_slice_header_bits
+    AppendNal(stream, HEVC_NAL_PPS, pps.finish(0, rng));
+
+    AppendPicture(stream, HEVC_NAL_CRA_NUT, 8, true, rng);
+    AppendPicture(stream, RASL_R, 6, true, rng);
+    AppendPicture(stream, RASL_R, 7, true, rng);
+    AppendPicture(stream, TRAIL_R, 9, true, rng);
+    AppendPicture(stream, TRAIL_R, 10, true, rng);
+    for (size_t g = 0; g < gops; g++) {
+        AppendPicture(stream, HEVC_NAL_IDR_W_RADL, 0, true, rng);
+        AppendPicture(stream, RADL_R, 14, true, rng);  // POC -2
+        AppendPicture(stream, TRAIL_R, 1, true, rng);
+        AppendPicture(stream, TRAIL_R, 2, true, rng);
+        AppendPicture(stream, TRAIL_R, 3, false, rng);
+    }
+    return stream;
+}
+
+// Output positions of the segments split at IDRs tile [0, OutputCount()) without a gap or
+// overlap, and every picture output by a segment falls into its own bounds
+inline bool SegmentsOwnTheirOutput(const HevcIndex& index, const std::vector<mfxU32>& starts) {
+    mfxU32 expected_first = 0;
+    for (size_t j = 0; j < starts.size(); j++) {
+        mfxU32 end = (j + 1 < starts.size()) ? starts[j + 1] : (mfxU32)index.FrameCount();
+        mfxU32 first = index.FirstOutputFrom(starts[j]);
+        mfxU32 last = (j + 1 < starts.size()) ? index.FirstOutputFrom(end) : index.OutputCount();
+        if (first != expected_first || last < first)
+            return false;
+        mfxU32 output = 0;
+        for (mfxU32 au = starts[j]; au < end; au++) {
+            mfxU32 position = index.DisplayIndex(au);
+            if (position == HEVC_NOT_DISPLAYED)
+                continue;
+            if (position < first || position >= last)
+                return false;
+            output++;
+        }
+        if (output != last - first)
+            return false;
+        expected_first = last;
+    }
+    return expected_first == index.OutputCount();
+}
+
+inline void RunHevcIndexBenchmarks() {
+    std::vector<mfxU8> stream = CreateSyntheticHevc(BENCH_HEVC_GOPS);
+    HevcIndex index;
+    Report("hevc_index/build", BestOf(3, [&] { index.Build(stream.data(), stream.size()); }),
+           (double)stream.size(), "B");
+    Report("hevc_index/display_order", BestOf(3, [&] { index.UpdateDisplayOrder(stream.data(), stream.size()); }),
+           (double)index.FrameCount(), "frames");
+
+    VERIFY(index.FrameCount() == 5 + 5 * BENCH_HEVC_GOPS, "hevc_index/build: access unit count mismatch");
+    VERIFY(!index.display.empty(), "hevc_index/display_order: headers not parsed");
+    if (index.display.empty())
+        return;
+    VERIFY(index.OutputCount() == 3 + 4 * BENCH_HEVC_GOPS, "hevc_index/display_order: output count mismatch");
+    VERIFY(index.display[1] == HEVC_NOT_DISPLAYED && index.display[2] == HEVC_NOT_DISPLAYED,
+           "hevc_index/display_order: RASL pictures of the leading CRA are output");
+    VERIFY(index.display[6] == 3 && index.display[5] == 4, "hevc_index/display_order: RADL not output before its IDR");
+    VERIFY(index.FirstOutputFrom(5) == 3, "hevc_index/segments: first output of an IDR sequence misplaced");
+    VERIFY(SegmentsOwnTheirOutput(index, SplitAtIdr(index, BENCH_HEVC_SEGMENTS)),
+           "hevc_index/segments: output positions of the segments overlap or leave gaps");
+}
+}  // namespace bench
@@ -0,0 +1,59 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Micro-benchmarks for the host-side hot paths of the demos,
+/// run on synthetic inputs so no GPU is needed
+///
+/// @file
+
+#include "batch_bench.h"
+#include "bitstream_bench.h"
+#include "decode_pool_bench.h"
+#include "hevc_index_bench.h"
+#include "queue_bench.h"
+#include "raw_frame_bench.h"
+#include "results_bench.h"
+#include "schedule_bench.h"
+#include "yolo_bench.h"
+
+int main(int argc, char* argv[]) {
+    // optional arguments: the benchmark group to run and -json <path> ("-" for stdout)
+    std::string filter;
+    std::string json;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-json" && i + 1 < argc)
+            json = argv[++i];
+        else
+            filter = arg;
+    }
+
+    if (filter.empty() || filter == "bitstream")
+        bench::RunBitstreamBenchmarks();
+    if (filter.empty() || filter == "queue")
+        bench::RunQueueBenchmarks();
+    if (filter.empty() || filter == "batch")
+        bench::RunBatchBenchmarks();
+    if (filter.empty() || filter == "results")
+        bench::RunResultsBenchmarks();
+    if (filter.empty() || filter == "raw_frame")
+        bench::RunRawFrameBenchmarks();
+    if (filter.empty() || filter == "schedule")
+        bench::RunScheduleBenchmarks();
+    if (filter.empty() || filter == "decode_pool")
+        bench::RunDecodePoolBenchmarks();
+    if (filter.empty() || filter == "yolo")
+        bench::RunYoloBenchmarks();
+    if (filter.empty() || filter == "hevc_index")
+        bench::RunHevcIndexBenchmarks();
+
+    if (!json.empty() && !bench::WriteJson(json)) {
+        printf("Not able to write %s\n", json.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,137 @@
+"""End-to-end performance regression check without a GPU.
+
+Runs the multi-source demo on the oneVPL CPU runtime and the OpenVINO CPU plugin
+(-device CPU) with a tiny synthetic detection model, records frames/s, frame
+latency percentiles and peak RSS, and compares them with a baseline JSON.
+The OpenCV pipeline of test.py runs on the same input as a comparison row.
+
+    python3 bench/perf_regression.py --demo build/multi_src/multi_source --update   # record the baseline
+    python3 bench/perf_regression.py --demo build/multi_src/multi_source            # exit 1 on regression
+"""
+
+import argparse
+import json
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+MODEL_SIZE = 128  # model input height and width
+MODEL_DETECTIONS = 50  # rows of the [1, 1, N, 7] output
+
+
+# Mean color of the image mapped to detection rows: cheap to infer, same output layout as the real model
+def create_model(xml_path):
+    import numpy as np
+    from openvino.runtime import Model, serialize
+    from openvino.runtime import opset8 as ops
+
+    rng = np.random.default_rng(0)
+    image = ops.parameter([1, 3, MODEL_SIZE, MODEL_SIZE], np.float32, name="image")
+    pooled = ops.reduce_mean(image, ops.constant(np.array([2, 3], np.int64)), False)
+    weights = ops.constant(rng.standard_normal((3, MODEL_DETECTIONS * 7)).astype(np.float32) / 128)
+    rows = ops.sigmoid(ops.matmul(pooled, weights, False, False))
+    output = ops.reshape(rows, ops.constant(np.array([1, 1, -1, 7], np.int64)), False)
+    serialize(Model([output], [image], "synthetic_detection"), xml_path, xml_path[:-4] + ".bin")
+
+
+def run_demo(demo, input_path, model, args, report_path):
+    command = [demo, "-i", input_path, "-m", model, "-device", "CPU", "-fr", "100000",
+               "-bs", str(args.bs), "-nr", str(args.nr), "-report_json", report_path]
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+    with open(report_path) as f:
+        return json.load(f)
+
+
+# Median over the runs, peak RSS is the largest one
+def summarize(reports):
+    return {
+        "fps": statistics.median(r["fps"] for r in reports),
+        "latency_ms": {p: statistics.median(r["latency_ms"][p] for r in reports) for p in ("p50", "p90", "p99")},
+        "peak_rss_mb": max(r["peak_rss_mb"] for r in reports),
+    }
+
+
+def run_opencv(input_path, model):
+    sys.path.insert(0, REPO)
+    try:
+        import test
+    except ImportError as e:
+        print("OpenCV baseline skipped: %s" % e)
+        return None
+    frames, seconds = test.run(input_path, model, "CPU")
+    return {"fps": frames / seconds if seconds > 0 else 0}
+
+
+# Returns the regressions of current against baseline, threshold in percent
+def compare(current, baseline, threshold):
+    limit = threshold / 100.0
+    regressions = []
+    if current["fps"] < baseline["fps"] * (1 - limit):
+        regressions.append("fps %.1f < %.1f" % (current["fps"], baseline["fps"]))
+    for p in ("p50", "p99"):
+        if current["latency_ms"][p] > baseline["latency_ms"][p] * (1 + limit):
+            regressions.append("latency %s %.2f ms > %.2f ms" % (p, current["latency_ms"][p], baseline["latency_ms"][p]))
+    if current["peak_rss_mb"] > baseline["peak_rss_mb"] * (1 + limit):
+        regressions.append("peak RSS %.1f MB > %.1f MB" % (current["peak_rss_mb"], baseline["peak_rss_mb"]))
+    return regressions
+
+
+def print_row(name, result):
+    if "latency_ms" in result:
+        print("%-22s %10.1f fps  p50 %8.2f ms  p90 %8.2f ms  p99 %8.2f ms  peak RSS %8.1f MB" % (
+            name, result["fps"], result["latency_ms"]["p50"], result["latency_ms"]["p90"],
+            result["latency_ms"]["p99"], result["peak_rss_mb"]))
+    else:
+        print("%-22s %10.1f fps" % (name, result["fps"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--demo", default=os.path.join(REPO, "build", "multi_src", "multi_source"))
+    parser.add_argument("--input", default=os.path.join(REPO, "content", "cars_320x240.h265"))
+    parser.add_argument("--baseline", default=os.path.join(REPO, "bench", "perf_baseline.json"))
+    parser.add_argument("--threshold", type=float, default=10, help="allowed regression in percent")
+    parser.add_argument("--runs", type=int, default=3)
+    parser.add_argument("--bs", type=int, default=1)
+    parser.add_argument("--nr", type=int, default=2)
+    parser.add_argument("--update", action="store_true", help="write the results as the new baseline")
+    parser.add_argument("--no-opencv", action="store_true", help="skip the test.py comparison row")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as tmp:
+        model = os.path.join(tmp, "synthetic_detection.xml")
+        create_model(model)
+        reports = [run_demo(args.demo, args.input, model, args, os.path.join(tmp, "report%d.json" % i))
+                   for i in range(args.runs)]
+        results = {"multi_source_cpu": summarize(reports)}
+        if not args.no_opencv:
+            opencv = run_opencv(args.input, model)
+            if opencv:
+                results["opencv_cpu"] = opencv
+
+    for name, result in results.items():
+        print_row(name, result)
+
+    if args.update:
+        with open(args.baseline, "w") as f:
+            json.dump(results, f, indent=2)
+        print("Baseline written to %s" % args.baseline)
+        return 0
+    if not os.path.exists(args.baseline):
+        print("No baseline at %s, record one with --update" % args.baseline)
+        return 1
+    with open(args.baseline) as f:
+        baseline = json.load(f)
+    # only the demo is gated, the OpenCV row is for comparison
+    regressions = compare(results["multi_source_cpu"], baseline["multi_source_cpu"], args.threshold)
+    print_row("baseline", baseline["multi_source_cpu"])
+    for regression in regressions:
+        print("REGRESSION: %s" % regression)
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "blocking_queue.h"
+#include "mpmc_queue.h"
+
+#define BENCH_QUEUE_ITEMS (1 << 18)
+#define BENCH_QUEUE_CAPACITY 16
+
+namespace bench {
+typedef std::pair<void*, size_t> QueueItem;
+
+// producers push their share of the items, one consumer drains them like the batching loop
+template <typename Push, typename Drain>
+void RunProducers(int producers, Push push, Drain drain) {
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.push_back(std::thread([=] {
+            for (size_t i = p; i < BENCH_QUEUE_ITEMS; i += producers)
+                push(QueueItem(nullptr, i));
+        }));
+    }
+    drain(BENCH_QUEUE_ITEMS);
+    for (auto& thread : threads)
+        thread.join();
+}
+
+inline void RunQueueBenchmarks() {
+    const int producer_counts[] = {1, 2, 4, 8, 16, 32, 64};
+    for (int producers : producer_counts) {
+        std::string suffix = "/producers=" + std::to_string(producers);
+
+        Report("queue/blocking_queue" + suffix, BestOf(3, [&] {
+                   multi_source::BlockingQueue<QueueItem> queue;
+                   RunProducers(producers,
+                                [&](QueueItem item) { queue.push(item, BENCH_QUEUE_CAPACITY); },
+                                [&](size_t n) {
+                                    for (size_t i = 0; i < n; i++)
+                                        queue.pop();
+                                });
+               }), BENCH_QUEUE_ITEMS, "items");
+
+        Report("queue/mpmc_queue" + suffix, BestOf(3, [&] {
+                   multi_source::MpmcQueue<QueueItem> queue(BENCH_QUEUE_CAPACITY);
+                   RunProducers(producers,
+                                [&](QueueItem item) { queue.push(item); },
+                                [&](size_t n) {
+                                    for (size_t i = 0; i < n; i++)
+                                        queue.pop();
+                                });
+               }), BENCH_QUEUE_ITEMS, "items");
+
+        Report("queue/mpmc_queue_pop_n" + suffix, BestOf(3, [&] {
+                   multi_source::MpmcQueue<QueueItem> queue(BENCH_QUEUE_CAPACITY);
+                   RunProducers(producers,
+                                [&](QueueItem item) { queue.push(item); },
+                                [&](size_t n) {
+                                    QueueItem items[BENCH_QUEUE_CAPACITY];
+                                    for (size_t i = 0; i < n;)
+                                        i += queue.pop_n(items, BENCH_QUEUE_CAPACITY);
+                                });
+               }), BENCH_QUEUE_ITEMS, "items");
+    }
+}
+}  // namespace bench
@@ -0,0 +1,86 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <unistd.h>
+#include <vector>
+#include "bench.h"
+#include "utils/util.h"
+
+#define BENCH_RAW_WIDTH 1920
+#define BENCH_RAW_HEIGHT 1080
+#define BENCH_RAW_FRAMES 64
+
+namespace bench {
+// System memory surface with a padded pitch, planes laid out as the decoder does
+struct RawSurface {
+    RawSurface(mfxU32 fourcc, mfxU16 width, mfxU16 height) : buffer(FrameSize(width, height)) {
+        surface.Info.FourCC = fourcc;
+        surface.Info.Width = width;
+        surface.Info.Height = height;
+        surface.Data.Pitch = Pitch(width);
+        mfxU8* base = buffer.data();
+        surface.Data.Y = base;
+        if (fourcc == MFX_FOURCC_NV12) {
+            surface.Data.UV = base + surface.Data.Pitch * height;
+        } else {
+            surface.Data.U = base + surface.Data.Pitch * height;
+            surface.Data.V = surface.Data.U + surface.Data.Pitch / 2 * height / 2;
+        }
+        XorShift rng;
+        for (auto& byte : buffer)
+            byte = (mfxU8)rng.next();
+    }
+
+    static mfxU16 Pitch(mfxU16 width) {
+        return (width + 63) & ~63;
+    }
+
+    static size_t FrameSize(mfxU16 width, mfxU16 height) {
+        return (size_t)Pitch(width) * height * 3 / 2;
+    }
+
+    std::vector<mfxU8> buffer;
+    mfxFrameSurface1 surface = {};
+};
+
+inline void RunRawFrameBenchmarks() {
+    const std::pair<mfxU32, const char*> formats[] = {{MFX_FOURCC_NV12, "nv12"}, {MFX_FOURCC_I420, "i420"}};
+    const double bytes = (double)BENCH_RAW_WIDTH * BENCH_RAW_HEIGHT * 3 / 2 * BENCH_RAW_FRAMES;
+    for (auto& format : formats) {
+        char path[] = "/tmp/vpl_demo_bench_raw_XXXXXX";
+        int fd = mkstemp(path);
+        if (fd < 0) {
+            printf("Not able to create synthetic raw file\n");
+            return;
+        }
+        close(fd);
+
+        RawSurface source(format.first, BENCH_RAW_WIDTH, BENCH_RAW_HEIGHT);
+        Report(std::string("raw_frame/write/") + format.second, BestOf(3, [&] {
+                   FILE* f = fopen(path, "wb");
+                   for (int i = 0; i < BENCH_RAW_FRAMES; i++)
+                       WriteRawFrame(&source.surface, f);
+                   fclose(f);
+               }), bytes, "B");
+
+        RawSurface target(format.first, BENCH_RAW_WIDTH, BENCH_RAW_HEIGHT);
+        int frames = 0;
+        Report(std::string("raw_frame/read/") + format.second, BestOf(3, [&] {
+                   FILE* f = fopen(path, "rb");
+                   frames = 0;
+                   while (frames < BENCH_RAW_FRAMES && ReadRawFrame(&target.surface, f) == MFX_ERR_NONE)
+                       frames++;
+                   fclose(f);
+               }), bytes, "B");
+        VERIFY(frames == BENCH_RAW_FRAMES, "raw_frame/read: frame count mismatch");
+        VERIFY(memcmp(target.surface.Data.Y, source.surface.Data.Y, BENCH_RAW_WIDTH) == 0,
+               "raw_frame/read: content mismatch");
+        unlink(path);
+    }
+}
+}  // namespace bench
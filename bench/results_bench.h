@@ -0,0 +1,92 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <vector>
+#include "bench.h"
+#include "utils/detections.h"
+
+#define BENCH_RESULTS_BATCH 8
+#define BENCH_RESULTS_ROWS 200  // detections per output, as vehicle-detection-0200
+#define BENCH_RESULTS_OUTPUTS 20000
+#define BENCH_RESULTS_VARIANTS 256  // distinct outputs cycled through, one would be learned by the branch predictor
+
+namespace bench {
+// Detection outputs of one batch each: rows spread over the batch slots, about a quarter
+// above the threshold, terminated early by a negative image_id like the real model
+inline std::vector<float> CreateSyntheticDetections(size_t outputs = 1) {
+    XorShift rng;
+    std::vector<float> output(outputs * BENCH_RESULTS_ROWS * DETECTION_SIZE);
+    size_t rows = BENCH_RESULTS_ROWS * 9 / 10;
+    for (size_t i = 0; i < outputs * BENCH_RESULTS_ROWS; i++) {
+        float* row = &output[i * DETECTION_SIZE];
+        size_t r   = i % BENCH_RESULTS_ROWS;
+        row[0] = (r < rows) ? (float)(r * BENCH_RESULTS_BATCH / rows) : -1.0f;
+        row[1] = (float)(rng.next() % 4);
+        row[2] = (rng.next() % 4 == 0) ? 0.5f + (rng.next() % 500) / 1000.0f : (rng.next() % 500) / 1000.0f;
+        for (int c = 3; c < DETECTION_SIZE; c++)
+            row[c] = (rng.next() % 1000) / 1000.0f;
+    }
+    return output;
+}
+
+// Every parser must compact the same detections as the scalar one
+inline bool SameDetections(const DetectionBatch& a, const DetectionBatch& b) {
+    if (a.count != b.count)
+        return false;
+    for (size_t i = 0; i < a.count; i++)
+        if (a.image_id[i] != b.image_id[i] || a.label[i] != b.label[i] || a.confidence[i] != b.confidence[i] ||
+            a.x_min[i] != b.x_min[i] || a.y_min[i] != b.y_min[i] || a.x_max[i] != b.x_max[i] || a.y_max[i] != b.y_max[i])
+            return false;
+    return true;
+}
+
+inline void RunResultsBenchmarks() {
+    std::vector<float> outputs = CreateSyntheticDetections(BENCH_RESULTS_VARIANTS);
+    auto output = [&](int i) { return &outputs[(i % BENCH_RESULTS_VARIANTS) * BENCH_RESULTS_ROWS * DETECTION_SIZE]; };
+    std::vector<DecodedFrame> frames;
+    for (size_t b = 0; b < BENCH_RESULTS_BATCH; b++)
+        frames.push_back({NULL, b % 2, b, b * 33.3, std::chrono::steady_clock::now(), 1080, 1920});
+
+    // every instruction set this CPU has, up to the one picked at runtime
+    DetectionBatch detections;
+    DetectionBatch reference;
+    for (int isa = DETECTION_SCALAR; isa <= BestDetectionIsa(); isa++) {
+        Report(std::string("results/parse_detections/") + DetectionIsaName((DetectionIsa)isa), BestOf(3, [&] {
+                   for (int i = 0; i < BENCH_RESULTS_OUTPUTS; i++)
+                       ParseDetections(output(i), BENCH_RESULTS_ROWS, DETECTION_THRESHOLD, detections, (DetectionIsa)isa);
+               }), BENCH_RESULTS_OUTPUTS, "outputs");
+        for (int i = 0; i < BENCH_RESULTS_VARIANTS; i++) {
+            ParseDetections(output(i), BENCH_RESULTS_ROWS, DETECTION_THRESHOLD, reference, DETECTION_SCALAR);
+            ParseDetections(output(i), BENCH_RESULTS_ROWS, DETECTION_THRESHOLD, detections, (DetectionIsa)isa);
+            VERIFY(reference.count > 0, "results/parse_detections: nothing parsed");
+            VERIFY(SameDetections(detections, reference), "results/parse_detections: differs from the scalar parser");
+        }
+    }
+
+    size_t kept = 0;
+    Report("results/parse_and_scale", BestOf(3, [&] {
+               for (int i = 0; i < BENCH_RESULTS_OUTPUTS; i++) {
+                   ParseDetections(output(i), BENCH_RESULTS_ROWS, DETECTION_THRESHOLD, detections);
+                   ScaleDetections(detections, frames);
+                   kept += detections.count;
+               }
+           }), BENCH_RESULTS_OUTPUTS, "outputs");
+    VERIFY(kept > 0, "results/parse_and_scale: nothing kept");
+
+    size_t bytes = 0;
+    Report("results/format_detections", BestOf(3, [&] {
+               for (int i = 0; i < BENCH_RESULTS_OUTPUTS; i++) {
+                   ParseDetections(output(i), BENCH_RESULTS_ROWS, DETECTION_THRESHOLD, detections);
+                   ScaleDetections(detections, frames);
+                   for (auto& text : FormatDetections(detections, frames))
+                       bytes += text.size();
+               }
+           }), BENCH_RESULTS_OUTPUTS, "outputs");
+    VERIFY(bytes > 0, "results/format_detections: nothing formatted");
+}
+}  // namespace bench
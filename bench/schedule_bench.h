@@ -0,0 +1,186 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <math.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "fair_scheduler.h"
+#include "mpmc_queue.h"
+#include "utils/decoded_frame.h"
+#include "utils/metrics.h"
+
+#define BENCH_SCHEDULE_FRAMES (1 << 15)  // pushed by every stream
+#define BENCH_SCHEDULE_QUEUE_SIZE 8
+#define BENCH_SCHEDULE_INFER_US 20  // consumer time per frame in the starvation run
+#define BENCH_SCHEDULE_SLOW_FRAMES 200
+#define BENCH_SCHEDULE_SLOW_INTERVAL_US 500
+#define BENCH_SCHEDULE_LIVE_FRAMES 400
+#define BENCH_SCHEDULE_LIVE_INTERVAL_US 100  // camera frame interval, half the consumer time per frame
+
+namespace bench {
+inline DecodedFrame ScheduleFrame(size_t stream, size_t index) {
+    static mfxFrameSurface1 surface = {};  // never read, only marks a frame as valid
+    return {&surface, stream, index, 0, std::chrono::steady_clock::now(), 1080, 1920};
+}
+
+inline void SpinFor(std::chrono::microseconds duration) {
+    auto end = std::chrono::steady_clock::now() + duration;
+    while (std::chrono::steady_clock::now() < end) {
+    }
+}
+
+// Streams with weights 1, 1, 2, 4 that all have frames waiting: the shares must follow the weights.
+// The queues are filled up front, a consumer faster than the producers would leave nothing to weigh.
+inline void RunWeightedShares() {
+    const double weights[] = {1, 1, 2, 4};
+    const size_t streams = sizeof(weights) / sizeof(weights[0]);
+    std::vector<size_t> counts(streams);
+    Report("schedule/fair_scheduler/streams=4", BestOf(3, [&] {
+               multi_source::FairScheduler<DecodedFrame> scheduler(BENCH_SCHEDULE_FRAMES);
+               DecodedFrame frame;
+               for (size_t s = 0; s < streams; s++) {
+                   scheduler.add_stream(s, weights[s]);
+                   for (size_t i = 0; i < BENCH_SCHEDULE_FRAMES; i++)
+                       scheduler.push(s, ScheduleFrame(s, i), &frame);
+               }
+               // shares are counted while every stream still has frames
+               std::fill(counts.begin(), counts.end(), 0);
+               for (size_t i = 0; i < streams * BENCH_SCHEDULE_FRAMES; i++) {
+                   scheduler.try_pop(frame);
+                   if (i < BENCH_SCHEDULE_FRAMES)
+                       counts[frame.stream_id]++;
+               }
+           }), streams * BENCH_SCHEDULE_FRAMES, "frames");
+
+    double weight_sum = 0;
+    for (double weight : weights)
+        weight_sum += weight;
+    for (size_t s = 0; s < streams; s++) {
+        double share = (double)counts[s] / BENCH_SCHEDULE_FRAMES;
+        printf("  stream %zu weight %.0f: %.1f%% share\n", s, weights[s], share * 100);
+        VERIFY(fabs(share - weights[s] / weight_sum) < 0.05, "schedule/fair_scheduler: share does not follow weight");
+    }
+}
+
+// A slow stream next to one that always has a frame ready, behind a consumer that takes
+// BENCH_SCHEDULE_INFER_US per frame: queueing delay of the slow stream's frames.
+// Queue is a shared MpmcQueue (fair == false) or a FairScheduler.
+inline void RunSlowStream(bool fair) {
+    LatencyHistogram slow_wait;
+    Report(std::string("schedule/slow_stream/") + (fair ? "fair_scheduler" : "shared_fifo"), BestOf(1, [&] {
+               multi_source::FairScheduler<DecodedFrame> scheduler(BENCH_SCHEDULE_QUEUE_SIZE);
+               multi_source::MpmcQueue<DecodedFrame> fifo(2 * BENCH_SCHEDULE_QUEUE_SIZE);
+               scheduler.add_stream(0);
+               scheduler.add_stream(1);
+               std::atomic<bool> done(false);
+               std::atomic<bool> fast_finished(false);
+               std::thread fast([&] {
+                   DecodedFrame dropped;
+                   for (size_t i = 0; !done; i++) {
+                       if (fair)
+                           scheduler.push(0, ScheduleFrame(0, i), &dropped);
+                       else
+                           fifo.push(ScheduleFrame(0, i));
+                   }
+                   fast_finished = true;
+               });
+               std::thread slow([&] {
+                   DecodedFrame dropped;
+                   for (size_t i = 0; i < BENCH_SCHEDULE_SLOW_FRAMES; i++) {
+                       std::this_thread::sleep_for(std::chrono::microseconds(BENCH_SCHEDULE_SLOW_INTERVAL_US));
+                       if (fair)
+                           scheduler.push(1, ScheduleFrame(1, i), &dropped);
+                       else
+                           fifo.push(ScheduleFrame(1, i));
+                   }
+               });
+               size_t slow_frames = 0;
+               DecodedFrame frame;
+               while (slow_frames < BENCH_SCHEDULE_SLOW_FRAMES) {
+                   if (fair)
+                       scheduler.pop_until(frame, std::chrono::steady_clock::time_point::max());
+                   else
+                       frame = fifo.pop();
+                   if (frame.stream_id == 1) {
+                       slow_wait.record((unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                            std::chrono::steady_clock::now() - frame.queued)
+                                            .count());
+                       slow_frames++;
+                   }
+                   SpinFor(std::chrono::microseconds(BENCH_SCHEDULE_INFER_US));
+               }
+               // the fast producer may be parked on a full queue, keep popping until it has seen done
+               done = true;
+               while (!fast_finished) {
+                   if (fair)
+                       scheduler.try_pop(frame);
+                   else
+                       fifo.try_pop(frame);
+               }
+               fast.join();
+               slow.join();
+           }), BENCH_SCHEDULE_SLOW_FRAMES, "frames");
+    LatencySummary wait;
+    wait.add(slow_wait);
+    printf("  slow stream queue wait p50 %.3f ms, p99 %.3f ms\n", wait.percentile_ns(50) / 1e6, wait.percentile_ns(99) / 1e6);
+}
+
+// A live stream producing twice as fast as the consumer takes its frames: age of the inferred
+// frames since their capture time. Blocking makes the age grow with the backlog, the drop
+// policies keep it bounded by the queue size.
+inline void RunOverload(multi_source::OverflowPolicy policy, const char* name) {
+    LatencyHistogram age;
+    size_t inferred = 0;
+    unsigned long long dropped = 0;
+    Report(std::string("schedule/overload/") + name, BestOf(1, [&] {
+               multi_source::FairScheduler<DecodedFrame> scheduler(BENCH_SCHEDULE_QUEUE_SIZE);
+               scheduler.add_stream(0, 1.0, policy);
+               std::thread camera([&] {
+                   auto start = std::chrono::steady_clock::now();
+                   DecodedFrame evicted;
+                   for (size_t i = 0; i < BENCH_SCHEDULE_LIVE_FRAMES; i++) {
+                       DecodedFrame frame = ScheduleFrame(0, i);
+                       // captured on schedule, whether or not the previous push had to wait
+                       frame.queued = start + std::chrono::microseconds(i * BENCH_SCHEDULE_LIVE_INTERVAL_US);
+                       std::this_thread::sleep_until(frame.queued);
+                       scheduler.push(0, frame, &evicted);
+                   }
+                   scheduler.close();
+               });
+               DecodedFrame frame;
+               while (scheduler.pop_until(frame, std::chrono::steady_clock::time_point::max()) && frame.surface) {
+                   SpinFor(std::chrono::microseconds(2 * BENCH_SCHEDULE_LIVE_INTERVAL_US));
+                   age.record((unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - frame.queued)
+                                  .count());
+                   inferred++;
+               }
+               camera.join();
+               dropped = scheduler.dropped();
+           }), BENCH_SCHEDULE_LIVE_FRAMES, "frames");
+    LatencySummary summary;
+    summary.add(age);
+    printf("  %zu inferred, %llu dropped, frame age p50 %.2f ms, p99 %.2f ms\n",
+           inferred,
+           dropped,
+           summary.percentile_ns(50) / 1e6,
+           summary.percentile_ns(99) / 1e6);
+    VERIFY(inferred + dropped == BENCH_SCHEDULE_LIVE_FRAMES, "schedule/overload: frames lost");
+}
+
+inline void RunScheduleBenchmarks() {
+    RunWeightedShares();
+    RunSlowStream(false);
+    RunSlowStream(true);
+    RunOverload(multi_source::OVERFLOW_BLOCK, "block");
+    RunOverload(multi_source::OVERFLOW_DROP_OLDEST, "drop_oldest");
+    RunOverload(multi_source::OVERFLOW_DROP_NEWEST, "drop_newest");
+}
+}  // namespace bench
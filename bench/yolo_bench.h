@@ -0,0 +1,182 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "bench.h"
+#include "utils/yolo.h"
+
+#define BENCH_YOLO_BATCH 2
+#define BENCH_YOLO_INPUT 640   // YOLOv5s input, heads of 80x80, 40x40 and 20x20 cells
+#define BENCH_YOLO_CLASSES 80  // COCO
+#define BENCH_YOLO_OBJECTS 30  // per image, each seen by a few neighboring cells
+#define BENCH_YOLO_BATCHES 200
+
+namespace bench {
+// Raw heads of one batch: background cells with low objectness, and objects whose 3x3 cells
+// all fire with slightly different boxes of the same class, for the suppression to remove
+struct SyntheticYolo {
+    std::vector<std::vector<float>> data;  // one buffer per head
+    std::vector<YoloHead> heads;
+    YoloConfig config;
+};
+
+inline float UniformIn(XorShift& rng, float low, float high) {
+    return low + (high - low) * (rng.next() % 10000) / 10000.0f;
+}
+
+inline SyntheticYolo CreateSyntheticYolo() {
+    SyntheticYolo yolo;
+    ParseYoloAnchors(YOLO_DEFAULT_ANCHORS, &yolo.config.anchors);
+    yolo.config.inputWidth = yolo.config.inputHeight = BENCH_YOLO_INPUT;
+    XorShift rng;
+    size_t channels = YOLO_BOX_SIZE + BENCH_YOLO_CLASSES;
+    for (size_t h = 0; h < yolo.config.anchors.size(); h++) {
+        size_t grid    = BENCH_YOLO_INPUT / (8 << h);
+        size_t cells   = grid * grid;
+        size_t anchors = yolo.config.anchors[h].size() / 2;
+        std::vector<float> data(BENCH_YOLO_BATCH * anchors * channels * cells);
+        for (size_t i = 0; i < data.size(); i++) {
+            size_t channel = (i / cells) % channels;
+            data[i] = channel == 4 ? UniformIn(rng, -9.0f, -2.0f) : UniformIn(rng, -4.0f, 1.0f);
+        }
+        yolo.data.push_back(data);
+    }
+
+    for (size_t b = 0; b < BENCH_YOLO_BATCH; b++)
+        for (size_t o = 0; o < BENCH_YOLO_OBJECTS; o++) {
+            size_t h       = rng.next() % yolo.data.size();
+            size_t grid    = BENCH_YOLO_INPUT / (8 << h);
+            size_t cells   = grid * grid;
+            size_t anchors = yolo.config.anchors[h].size() / 2;
+            size_t a       = rng.next() % anchors;
+            size_t x = 1 + rng.next() % (grid - 2), y = 1 + rng.next() % (grid - 2);
+            size_t label = rng.next() % BENCH_YOLO_CLASSES;
+            float* box   = &yolo.data[h][(b * anchors + a) * channels * cells];
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++) {
+                    size_t cell = (y + dy) * grid + x + dx;
+                    // the neighbors point back at the object's center
+                    box[cell]             = -dx * 1.1f + UniformIn(rng, -0.1f, 0.1f);
+                    box[cells + cell]     = -dy * 1.1f + UniformIn(rng, -0.1f, 0.1f);
+                    box[2 * cells + cell] = UniformIn(rng, 0.0f, 0.3f);
+                    box[3 * cells + cell] = UniformIn(rng, 0.0f, 0.3f);
+                    box[4 * cells + cell] = UniformIn(rng, 1.0f, 4.0f);
+                    box[(YOLO_BOX_SIZE + label) * cells + cell] = UniformIn(rng, 2.0f, 5.0f);
+                }
+        }
+
+    for (size_t h = 0; h < yolo.data.size(); h++) {
+        size_t grid = BENCH_YOLO_INPUT / (8 << h);
+        yolo.heads.push_back({yolo.data[h].data(),
+                              BENCH_YOLO_BATCH,
+                              yolo.config.anchors[h].size() / 2,
+                              BENCH_YOLO_CLASSES,
+                              grid,
+                              grid,
+                              yolo.config.anchors[h].data()});
+    }
+    return yolo;
+}
+
+// Straightforward decoder to compare with: every objectness and every class score of a passing
+// cell through expf, boxes as an array of structures, suppression with the IoU division
+struct ReferenceBox {
+    int image_id, label;
+    float confidence, x1, y1, x2, y2;
+};
+
+inline void ReferenceYolo(const SyntheticYolo& yolo, std::vector<ReferenceBox>& boxes) {
+    boxes.clear();
+    std::vector<ReferenceBox> candidates;
+    for (size_t b = 0; b < BENCH_YOLO_BATCH; b++) {
+        candidates.clear();
+        for (const YoloHead& head : yolo.heads) {
+            size_t cells = head.height * head.width, channels = YOLO_BOX_SIZE + head.classes;
+            for (size_t a = 0; a < head.anchors; a++) {
+                const float* box = head.data + (b * head.anchors + a) * channels * cells;
+                for (size_t cell = 0; cell < cells; cell++) {
+                    float objectness = YoloSigmoid(box[4 * cells + cell]);
+                    if (objectness < yolo.config.confidence)
+                        continue;
+                    int label  = 0;
+                    float best = 0;
+                    for (size_t c = 0; c < head.classes; c++) {
+                        float score = YoloSigmoid(box[(YOLO_BOX_SIZE + c) * cells + cell]);
+                        if (score > best)
+                            best = score, label = (int)c;
+                    }
+                    if (objectness * best < yolo.config.confidence)
+                        continue;
+                    float x = (2 * YoloSigmoid(box[cell]) - 0.5f + cell % head.width) / head.width;
+                    float y = (2 * YoloSigmoid(box[cells + cell]) - 0.5f + cell / head.width) / head.height;
+                    float w = powf(2 * YoloSigmoid(box[2 * cells + cell]), 2) * head.anchorSizes[2 * a] / BENCH_YOLO_INPUT;
+                    float h = powf(2 * YoloSigmoid(box[3 * cells + cell]), 2) * head.anchorSizes[2 * a + 1] / BENCH_YOLO_INPUT;
+                    candidates.push_back({(int)b, label, objectness * best, x - w / 2, y - h / 2, x + w / 2, y + h / 2});
+                }
+            }
+        }
+        std::stable_sort(candidates.begin(), candidates.end(), [](const ReferenceBox& l, const ReferenceBox& r) {
+            return l.confidence > r.confidence;
+        });
+        size_t first = boxes.size();
+        for (const ReferenceBox& c : candidates) {
+            bool keep = true;
+            for (size_t k = first; keep && k < boxes.size(); k++) {
+                const ReferenceBox& kept = boxes[k];
+                if (kept.label != c.label)
+                    continue;
+                float w     = std::max(0.0f, std::min(kept.x2, c.x2) - std::max(kept.x1, c.x1));
+                float h     = std::max(0.0f, std::min(kept.y2, c.y2) - std::max(kept.y1, c.y1));
+                float inter = w * h;
+                float area  = (kept.x2 - kept.x1) * (kept.y2 - kept.y1) + (c.x2 - c.x1) * (c.y2 - c.y1) - inter;
+                keep        = inter / area <= yolo.config.iou;
+            }
+            if (keep)
+                boxes.push_back(c);
+        }
+    }
+}
+
+// Same boxes in the same order, up to the rounding of the vectorized sigmoid
+inline bool SameYoloDetections(const DetectionBatch& d, const std::vector<ReferenceBox>& boxes) {
+    if (d.count != boxes.size())
+        return false;
+    for (size_t i = 0; i < d.count; i++) {
+        const ReferenceBox& r = boxes[i];
+        if (d.image_id[i] != r.image_id || d.label[i] != r.label || fabsf(d.confidence[i] - r.confidence) > 1e-4f ||
+            fabsf(d.x_min[i] - r.x1) > 1e-4f || fabsf(d.y_min[i] - r.y1) > 1e-4f || fabsf(d.x_max[i] - r.x2) > 1e-4f ||
+            fabsf(d.y_max[i] - r.y2) > 1e-4f)
+            return false;
+    }
+    return true;
+}
+
+inline void RunYoloBenchmarks() {
+    SyntheticYolo yolo = CreateSyntheticYolo();
+    std::vector<ReferenceBox> reference;
+    Report("yolo/reference", BestOf(3, [&] {
+               for (int i = 0; i < BENCH_YOLO_BATCHES; i++)
+                   ReferenceYolo(yolo, reference);
+           }), BENCH_YOLO_BATCHES * BENCH_YOLO_BATCH, "images");
+    VERIFY(!reference.empty() && reference.size() < BENCH_YOLO_BATCH * BENCH_YOLO_OBJECTS * 3,
+           "yolo/reference: suppression left no or too many boxes");
+    printf("  %zu boxes kept of %d objects\n", reference.size(), BENCH_YOLO_BATCH * BENCH_YOLO_OBJECTS);
+
+    DetectionBatch detections;
+    YoloScratch scratch;
+    for (int isa = DETECTION_SCALAR; isa <= BestDetectionIsa(); isa++) {
+        Report(std::string("yolo/decode_nms/") + DetectionIsaName((DetectionIsa)isa), BestOf(3, [&] {
+                   for (int i = 0; i < BENCH_YOLO_BATCHES; i++)
+                       DecodeYolo(yolo.heads, yolo.config, detections, scratch, (DetectionIsa)isa);
+               }), BENCH_YOLO_BATCHES * BENCH_YOLO_BATCH, "images");
+        VERIFY(SameYoloDetections(detections, reference), "yolo/decode_nms: differs from the reference");
+    }
+}
+}  // namespace bench
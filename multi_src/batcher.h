@@ -0,0 +1,99 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "utils/decoded_frame.h"
+#include "utils/metrics.h"
+
+namespace multi_source {
+// nearest-rank percentile, p in [0, 100]
+inline double Percentile(std::vector<double> values, double p) {
+    if (values.empty())
+        return 0;
+    size_t rank = (size_t)(p / 100 * values.size() + 0.5);
+    rank = std::min(std::max(rank, (size_t)1), values.size());
+    std::nth_element(values.begin(), values.begin() + rank - 1, values.end());
+    return values[rank - 1];
+}
+
+// Collects decoded frames into inference batches.
+// A batch is dispatched once it is full, once its oldest frame has waited max_wait,
+// or at the end of input, so a slow stream never holds back frames of the others.
+// A zero max_wait waits for full batches, only the last batch may be partial.
+// Source is Decode_vpp or anything else with its read_until().
+template <typename Source>
+class FrameBatcher {
+   public:
+    FrameBatcher(Source& decoder, size_t batch_size, std::chrono::microseconds max_wait, bool verbose = true)
+        : _decoder(decoder), _batchSize(batch_size), _maxWait(max_wait), _verbose(verbose) {}
+
+    // Fill batch with up to limit frames, returns false once the input has ended and nothing is left
+    bool next(std::vector<DecodedFrame>& batch, size_t limit) {
+        TraceScope batchScope("batch");
+        batch.clear();
+        limit = std::min(limit, _batchSize);
+        const char* reason = "full";
+        auto deadline = std::chrono::steady_clock::time_point::max();
+        while (batch.size() < limit) {
+            DecodedFrame frame;
+            if (!_decoder.read_until(frame, deadline)) {
+                reason = "deadline";
+                break;
+            }
+            if (!frame.surface) {
+                reason = "end of input";
+                break;
+            }
+            // the deadline follows the oldest frame of the batch
+            if (batch.empty() && _maxWait.count() > 0)
+                deadline = frame.queued + _maxWait;
+            batch.push_back(frame);
+        }
+        if (batch.empty())
+            return false;
+
+        // queueing delay: from the decode thread handing the frame over until the batch leaves
+        auto now = std::chrono::steady_clock::now();
+        std::vector<double> delays;
+        for (auto& frame : batch) {
+            delays.push_back(std::chrono::duration<double, std::milli>(now - frame.queued).count());
+            Metrics::Get().record(METRIC_QUEUE_WAIT, now - frame.queued);
+            Trace::Get().record(kMetricStageNames[METRIC_QUEUE_WAIT], frame.queued, now, frame.frame_index);
+        }
+        _delays.insert(_delays.end(), delays.begin(), delays.end());
+        if (_verbose)
+            printf("batch %zu: %zu/%zu frames (%s), queueing delay p50 %.2f ms, p99 %.2f ms\n",
+                   _batches,
+                   batch.size(),
+                   _batchSize,
+                   reason,
+                   Percentile(delays, 50),
+                   Percentile(delays, 99));
+        _batches++;
+        return true;
+    }
+
+    void print_summary() {
+        printf("%zu batches, queueing delay p50 %.2f ms, p99 %.2f ms\n",
+               _batches,
+               Percentile(_delays, 50),
+               Percentile(_delays, 99));
+    }
+
+   private:
+    Source& _decoder;
+    size_t _batchSize;
+    std::chrono::microseconds _maxWait;
+    bool _verbose;  // print every batch
+    size_t _batches = 0;
+    std::vector<double> _delays;
+};
+}  // namespace multi_source
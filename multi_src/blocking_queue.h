@@ -35,11 +35,13 @@ class BlockingQueue {
     }
 
     void clear() {
+        std::unique_lock<std::mutex> lock(_mutex);
         _queue.clear();
-        _pop_condition.notify_one();
+        _pop_condition.notify_all();
     }
 
     size_t size() {
+        std::unique_lock<std::mutex> lock(_mutex);
         return _queue.size();
     }
 
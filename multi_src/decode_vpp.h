@@ -1,303 +1,893 @@
-#include <gpu/gpu_context_api_va.hpp>
-#include <thread>
-#include "blocking_queue.h"
-#include "utils/util.h"
-#define MAX_QUEUE_SIZE 16
-#define BITSTREAM_BUFFER_SIZE 2000000
-#define SYNC_TIMEOUT 600000
-#define MAJOR_API_VERSION_REQUIRED 2
-#define MINOR_API_VERSION_REQUIRED 2
-
-namespace multi_source {
-class Decode_vpp {
-   public:
-    Decode_vpp(std::vector<std::string> inputs, const ov::Shape& shape) {
-        width = shape[3];
-        height = shape[2];
-        inputDimWidth = (mfxU16)width;
-        inputDimHeight = (mfxU16)height;
-
-        // Initialize the VPL session for each input source instance
-        for (int i = 0; i < inputs.size(); i++) {
-            FILE* source = NULL;
-            mfxSession session = NULL;
-            mfxLoader loader = NULL;
-            mfxBitstream bitstream = {};
-
-            const char* files = inputs[i].c_str();
-            source = fopen(files, "rb");
-            VERIFY(source, "Could not open input file");
-
-            // Create VPL session
-            session = CreateVPLSession(&loader, i);
-            VERIFY(session != NULL, "Not able to create VPL session");
-            //-- Initialize Decode
-            // Prepare input bitstream
-            bitstream.MaxLength = BITSTREAM_BUFFER_SIZE;
-            bitstream.Data = (mfxU8*)calloc(bitstream.MaxLength, sizeof(mfxU8));
-            VERIFY(bitstream.Data, "Not able to allocate input buffer");
-            bitstream.CodecId = MFX_CODEC_HEVC;
-
-            sts = ReadEncodedStream(bitstream, source);
-            VERIFY(MFX_ERR_NONE == sts, "Error reading bitstream");
-
-            // Retrieve the frame information from input stream
-            mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
-            mfxDecParams.IOPattern = MFX_IOPATTERN_OUT_VIDEO_MEMORY;
-            sts = MFXVideoDECODE_DecodeHeader(session, &bitstream, &mfxDecParams);
-            VERIFY(MFX_ERR_NONE == sts, "Error decoding header");
-
-            // Original image size
-            mfxU16 oriImgWidth = mfxDecParams.mfx.FrameInfo.Width;
-            mfxU16 oriImgHeight = mfxDecParams.mfx.FrameInfo.Height;
-            _oriImgShape.push_back(std::make_pair(oriImgHeight, oriImgWidth));
-
-            // Input parameters finished, now initialize decode
-            sts = MFXVideoDECODE_Init(session, &mfxDecParams);
-            VERIFY(MFX_ERR_NONE == sts, "Error initializing Decode");
-
-            //-- Initialize VPP
-            // Prepare vpp in/out params
-            // vpp in:  decode output image size
-            // vpp out: network model input size
-            vppInImgWidth = mfxDecParams.mfx.FrameInfo.Width;
-            vppInImgHeight = mfxDecParams.mfx.FrameInfo.Height;
-            vppOutImgWidth = inputDimWidth;
-            vppOutImgHeight = inputDimHeight;
-
-            mfxVPPParams.vpp.In.FourCC = mfxDecParams.mfx.FrameInfo.FourCC;
-            mfxVPPParams.vpp.In.ChromaFormat = mfxDecParams.mfx.FrameInfo.ChromaFormat;
-            mfxVPPParams.vpp.In.Width = vppInImgWidth;
-            mfxVPPParams.vpp.In.Height = vppInImgHeight;
-            mfxVPPParams.vpp.In.CropW = vppInImgWidth;
-            mfxVPPParams.vpp.In.CropH = vppInImgHeight;
-            mfxVPPParams.vpp.In.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
-            mfxVPPParams.vpp.In.FrameRateExtN = 30;
-            mfxVPPParams.vpp.In.FrameRateExtD = 1;
-
-            mfxVPPParams.vpp.Out.FourCC = MFX_FOURCC_NV12;
-            mfxVPPParams.vpp.Out.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
-            mfxVPPParams.vpp.Out.Width = ALIGN16(vppOutImgWidth);
-            mfxVPPParams.vpp.Out.Height = ALIGN16(vppOutImgHeight);
-            mfxVPPParams.vpp.Out.CropW = vppOutImgWidth;
-            mfxVPPParams.vpp.Out.CropH = vppOutImgHeight;
-            mfxVPPParams.vpp.Out.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
-            mfxVPPParams.vpp.Out.FrameRateExtN = 30;
-            mfxVPPParams.vpp.Out.FrameRateExtD = 1;
-
-            mfxVPPParams.IOPattern = MFX_IOPATTERN_IN_VIDEO_MEMORY | MFX_IOPATTERN_OUT_VIDEO_MEMORY;
-
-            // Initialize the VPP
-            sts = MFXVideoVPP_Init(session, &mfxVPPParams);
-            VERIFY(MFX_ERR_NONE == sts, "Error initializing VPP");
-
-            // Get the vaapi device handle
-            sts = MFXVideoCORE_GetHandle(session, MFX_HANDLE_VA_DISPLAY, &lvaDisplay);
-            VERIFY(MFX_ERR_NONE == sts, "MFXVideoCore_GetHandle error");
-
-            _sessions.push_back(session);
-            _bitstreams.push_back(bitstream);
-            _sources.push_back(source);
-        }
-    }
-
-    VADisplay get_context() {
-        return lvaDisplay;
-    }
-
-    std::vector<std::pair<mfxU16, mfxU16>> get_input_shape() {
-        return _oriImgShape;
-    }
-
-    ~Decode_vpp() {
-        for (auto& stream : _streams) {
-            stream.isStillGoing = false;
-            stream.thread.join();
-        }
-    }
-
-    void decoding(std::vector<std::string> inputs) {
-        for (auto& input : inputs) {
-            add_input(input);
-        }
-    }
-
-    void add_input(std::string url) {
-        // Create thread with frame reading loop
-        size_t stream_id = _streams.size();
-        _streams.push_back({});
-        _streams.back().thread = std::thread([=] {   
-            mfxFrameSurface1 *pmfxDecOutSurface = NULL;
-            mfxFrameSurface1 *pmfxVPPSurfacesOut = NULL;
-            mfxSyncPoint syncp = {};
-
-            while (_streams[stream_id].isStillGoing){
-                if (_streams[stream_id].isDrainingDec == false){
-                    _streams[stream_id].status = ReadEncodedStream(_bitstreams[stream_id], _sources[stream_id]);
-                    VERIFY(MFX_ERR_NONE == _streams[stream_id].status, "Error reading bitstream");
-                    if (_streams[stream_id].status != MFX_ERR_NONE)
-                        _streams[stream_id].isDrainingDec = true;
-                }
-
-                if (!_streams[stream_id].isDrainingVPP){
-                    _streams[stream_id].status = MFXVideoDECODE_DecodeFrameAsync(_sessions[stream_id],
-                                                                                (_streams[stream_id].isDrainingDec) ? NULL : &_bitstreams[stream_id],
-                                                                                NULL,
-                                                                                &pmfxDecOutSurface,
-                                                                                &syncp);
-                }
-                else{
-                    _streams[stream_id].status = MFX_ERR_NONE;
-                }
-
-                switch (_streams[stream_id].status){
-                case MFX_ERR_NONE:
-                    _streams[stream_id].status =
-                        MFXVideoVPP_ProcessFrameAsync(_sessions[stream_id], pmfxDecOutSurface, &pmfxVPPSurfacesOut);
-                    if (_streams[stream_id].status == MFX_ERR_NONE)
-                    {
-                        _streams[stream_id].status = pmfxVPPSurfacesOut->FrameInterface->Synchronize(pmfxVPPSurfacesOut,
-                                                                                                    SYNC_TIMEOUT);
-                        VERIFY(MFX_ERR_NONE == _streams[stream_id].status, "MFXVideoCORE_SyncOperation error");
-
-                        // wrap the VPP output and stream id into a shared surface queue
-                        _queue.push(std::make_pair(pmfxVPPSurfacesOut, stream_id), MAX_QUEUE_SIZE);
-                    }
-                    else if (_streams[stream_id].status == MFX_ERR_MORE_DATA)
-                    {
-                        if (_streams[stream_id].isDrainingVPP == true)
-                            _streams[stream_id].isStillGoing = false;
-                    }
-                    else
-                    {
-                        if (_streams[stream_id].status < 0)
-                            _streams[stream_id].isStillGoing = false;
-                    }
-                    break;
-                case MFX_ERR_MORE_DATA:
-                    // The function requires more bitstream at input before decoding can proceed
-                    if (_streams[stream_id].isDrainingDec)
-                        _streams[stream_id].isDrainingVPP = true;
-                    break;
-                }
-            }
-            _streams[stream_id].isStillGoing = false; });
-    }
-
-    std::pair<mfxFrameSurface1*, size_t> read() {
-        return _queue.pop();
-    }
-
-    mfxSession CreateVPLSession(mfxLoader* loader, int counter) {
-        mfxStatus sts = MFX_ERR_NONE;
-
-        // variables used only in 2.x version
-        mfxConfig cfg[4];
-        mfxVariant cfgVal;
-        mfxSession session = NULL;
-
-        //-- Create session
-        *loader = MFXLoad();
-        VERIFY2(NULL != *loader, "MFXLoad failed -- is implementation in path?\n");
-
-        // Implementation used must be the hardware implementation
-        cfg[0] = MFXCreateConfig(*loader);
-        VERIFY2(NULL != cfg[0], "MFXCreateConfig failed")
-        cfgVal.Type = MFX_VARIANT_TYPE_U32;
-        cfgVal.Data.U32 = MFX_IMPL_TYPE_HARDWARE;
-        sts = MFXSetConfigFilterProperty(cfg[0], (mfxU8*)"mfxImplDescription.Impl", cfgVal);
-        VERIFY2(MFX_ERR_NONE == sts, "MFXSetConfigFilterProperty failed for Impl");
-
-        // Implementation must provide an HEVC decoder
-        cfg[1] = MFXCreateConfig(*loader);
-        VERIFY2(NULL != cfg[1], "MFXCreateConfig failed")
-        cfgVal.Type = MFX_VARIANT_TYPE_U32;
-        cfgVal.Data.U32 = MFX_CODEC_HEVC;
-        sts = MFXSetConfigFilterProperty(
-            cfg[1],
-            (mfxU8*)"mfxImplDescription.mfxDecoderDescription.decoder.CodecID",
-            cfgVal);
-        VERIFY2(MFX_ERR_NONE == sts, "MFXSetConfigFilterProperty failed for decoder CodecID");
-
-        // Implementation used must have VPP scaling capability
-        cfg[2] = MFXCreateConfig(*loader);
-        VERIFY2(NULL != cfg[2], "MFXCreateConfig failed")
-        cfgVal.Type = MFX_VARIANT_TYPE_U32;
-        cfgVal.Data.U32 = MFX_EXTBUFF_VPP_SCALING;
-        sts = MFXSetConfigFilterProperty(
-            cfg[2],
-            (mfxU8*)"mfxImplDescription.mfxVPPDescription.filter.FilterFourCC",
-            cfgVal);
-        VERIFY2(MFX_ERR_NONE == sts, "MFXSetConfigFilterProperty failed for VPP scale");
-
-        // Implementation used must provide API version 2.2 or newer
-        cfg[3] = MFXCreateConfig(*loader);
-        VERIFY2(NULL != cfg[3], "MFXCreateConfig failed")
-        cfgVal.Type = MFX_VARIANT_TYPE_U32;
-        cfgVal.Data.U32 = VPLVERSION(MAJOR_API_VERSION_REQUIRED, MINOR_API_VERSION_REQUIRED);
-        sts = MFXSetConfigFilterProperty(cfg[3],
-                                         (mfxU8*)"mfxImplDescription.ApiVersion.Version",
-                                         cfgVal);
-        VERIFY2(MFX_ERR_NONE == sts, "MFXSetConfigFilterProperty failed for API version");
-
-        sts = MFXCreateSession(*loader, 0, &session);
-        VERIFY2(MFX_ERR_NONE == sts,
-                "Cannot create session -- no implementations meet selection criteria");
-
-        // share one vaapi device handle amonge different input source
-        if (counter == 0) {
-            VADisplay va_dpy = NULL;
-            int fd;
-            // initialize VAAPI context and set session handle (req in Linux)
-            fd = open("/dev/dri/renderD128", O_RDWR);
-            if (fd >= 0) {
-                va_dpy = vaGetDisplayDRM(fd);
-                if (va_dpy) {
-                    int major_version = 0, minor_version = 0;
-                    if (VA_STATUS_SUCCESS == vaInitialize(va_dpy, &major_version, &minor_version)) {
-                        sts = MFXVideoCORE_SetHandle(session,
-                                                     static_cast<mfxHandleType>(MFX_HANDLE_VA_DISPLAY),
-                                                     va_dpy);
-                        VERIFY(MFX_ERR_NONE == sts, "SetHandle error");
-                    }
-                }
-            }
-        } else {
-            sts = MFXVideoCORE_SetHandle(session,
-                                         static_cast<mfxHandleType>(MFX_HANDLE_VA_DISPLAY),
-                                         lvaDisplay);
-            VERIFY(MFX_ERR_NONE == sts, "SetHandle error");
-        }
-
-        // Print info about implementation loaded
-        ShowImplementationInfo(*loader, 0);
-        return session;
-    }
-
-   private:
-    BlockingQueue<std::pair<mfxFrameSurface1*, size_t>> _queue;
-    struct StreamState {
-        bool isStillGoing = true;
-        bool isDrainingDec = false;
-        bool isDrainingVPP = false;
-        mfxStatus status = MFX_ERR_NONE;
-        std::thread thread;
-    };
-    std::vector<StreamState> _streams;
-    std::vector<mfxSession> _sessions;
-    std::vector<mfxBitstream> _bitstreams;
-    std::vector<FILE*> _sources;
-    std::vector<std::pair<mfxU16, mfxU16>> _oriImgShape;
-    size_t width;
-    size_t height;
-
-    mfxStatus sts = MFX_ERR_NONE;
-    bool isNetworkLoaded = false;
-    mfxU16 inputDimWidth, inputDimHeight;
-    mfxU16 vppInImgWidth, vppInImgHeight;
-    mfxU16 vppOutImgWidth, vppOutImgHeight;
-    mfxVideoParam mfxDecParams = {};
-    mfxVideoParam mfxVPPParams = {};
-    VADisplay lvaDisplay;
-};
-}  // namespace multi_source
+#pragma once
+
+#include <gpu/gpu_context_api_va.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <thread>
+#include "blocking_queue.h"
+#include "fair_scheduler.h"
+#include "utils/cpu_topology.h"
+#include "utils/decoded_frame.h"
+#include "utils/hevc_index.h"
+#include "utils/metrics.h"
+#include "utils/thread_pool.h"
+#include "utils/util.h"
+#include "utils/work_stealing_pool.h"
+#define STREAM_QUEUE_SIZE 8
+#define BITSTREAM_BUFFER_SIZE 2000000
+#define MAJOR_API_VERSION_REQUIRED 2
+#define MINOR_API_VERSION_REQUIRED 2
+
+namespace multi_source {
+// Decode_vpp settings, the defaults decode every input as a plain byte stream
+struct DecodeOptions {
+    bool completeFrame = false;  // index each input and submit whole access units to the decoder
+    int segments = 1;            // split a single input at IDR boundaries and decode the parts in parallel sessions
+    size_t prefetchDepth = 0;    // bytes kept read ahead of every decoder, 0 reads on the decode threads
+    size_t ioThreads = 2;        // I/O threads shared by all inputs for the read-ahead
+    std::vector<double> inferFps;  // frames per second handed to inference for each input, 0 or missing keeps all
+    HevcDecodeMode decodeMode = HEVC_DECODE_ALL;  // pictures decoded, anything but all needs the index
+    bool systemMemory = false;   // software decode and VPP into system memory, no VA display (CPU inference)
+    size_t outputPool = 0;       // VPP output surfaces preallocated per input, 0 grows the pool on demand
+    size_t initThreads = 0;      // threads setting up the stream sessions, 0 uses one per stream up to the core count
+    size_t queueSize = STREAM_QUEUE_SIZE;  // decoded frames each stream may have waiting for inference
+    std::vector<double> weights;  // scheduling weight of each input, 1 or missing for an equal share
+    std::vector<OverflowPolicy> overflow;  // full queue policy of each input, missing blocks the decoder
+    size_t decodeThreads = 0;    // worker threads decoding all streams, 0 uses the core count
+    ThreadPlacement placement;   // pinning of the decode workers and NUMA node of each stream, none by default
+};
+
+class Decode_vpp {
+   public:
+    Decode_vpp(std::vector<std::string> inputs, const ov::Shape& shape, const DecodeOptions& options = DecodeOptions())
+        : _scheduler(options.queueSize) {
+        width = shape[3];
+        height = shape[2];
+        inputDimWidth = (mfxU16)width;
+        inputDimHeight = (mfxU16)height;
+        _completeFrame = options.completeFrame || options.decodeMode != HEVC_DECODE_ALL;
+        _decodeMode = options.decodeMode;
+        int segments = options.segments;
+        VERIFY(segments <= 1 || inputs.size() == 1, "Only a single input can be split into segments");
+        if (inputs.size() != 1)
+            segments = 1;
+        if (options.prefetchDepth > 0)
+            _prefetcher.reset(new Prefetcher(options.ioThreads, options.prefetchDepth));
+        _systemMemory = options.systemMemory;
+        _outputPool = options.outputPool;
+        _decodeThreads = options.decodeThreads > 0 ? options.decodeThreads
+                                                   : std::max<size_t>(1, std::thread::hardware_concurrency());
+        _placement = options.placement;
+        _scheduler.set_room_callback([this](size_t id) { resume(id); });
+
+        // One loader and VA display shared by every session, the implementation is enumerated once
+        _loader = CreateVPLLoader();
+        if (!_systemMemory)
+            lvaDisplay = OpenVADisplay();
+
+        // Collect the streams of each input source instance, their sessions are set up in parallel below
+        std::vector<Stream*> streams;
+        for (size_t i = 0; i < inputs.size(); i++) {
+            double inferFps = i < options.inferFps.size() ? options.inferFps[i] : 0;
+            double weight = i < options.weights.size() ? options.weights[i] : 1.0;
+            OverflowPolicy policy = i < options.overflow.size() ? options.overflow[i] : OVERFLOW_BLOCK;
+            add_input_streams(inputs[i], inferFps, weight, policy, segments, streams);
+        }
+        init_streams(streams, options.initThreads);
+    }
+
+    // Attach an input while the pipeline runs, its frames join the queue as soon as its session is up
+    // and the other streams keep decoding meanwhile. Returns the stream id, -1 if the input cannot be
+    // decoded or every stream has already ended. weight is its scheduling weight, policy what
+    // happens to its frames while its queue is full.
+    long attach(const std::string& path,
+                double inferFps = 0,
+                double weight = 1.0,
+                OverflowPolicy policy = OVERFLOW_BLOCK) {
+        reap();
+        std::vector<Stream*> streams;
+        add_input_streams(path, inferFps, weight, policy, 1, streams);
+        Stream* s = streams[0];
+        bool ready = false;
+        if (_placement.enabled()) {
+            // the host side buffers of the session are allocated on the node of its decode workers
+            std::thread init([&] {
+                PinCurrentThread(_placement.group_cpus(s->group));
+                ready = init_stream(s);
+            });
+            init.join();
+        } else {
+            ready = init_stream(s);
+        }
+        if (ready)
+            _surfaceGeneration.fetch_add(1, std::memory_order_acq_rel);
+        if (ready && _started) {
+            // the end of input may already have been queued, no stream is started after it
+            size_t running = _running.load();
+            do {
+                ready = running > 0;
+            } while (ready && !_running.compare_exchange_weak(running, running + 1));
+        }
+        if (!ready) {
+            drop_stream(s);
+            printf("Not able to attach %s\n", path.c_str());
+            return -1;
+        }
+        size_t id = s->id;
+        if (_started)
+            start_stream(s);
+        if (_placement.enabled())
+            printf("stream %zu: attached %s on node %d\n", id, path.c_str(), _placement.node_id(s->group));
+        else
+            printf("stream %zu: attached %s\n", id, path.c_str());
+        return (long)id;
+    }
+
+    // Stop decoding a stream, the others are not paused. Its frames already queued are still inferred,
+    // its session goes back to the free list once they are released and is reused by the next attach.
+    bool detach(size_t stream_id) {
+        {
+            std::lock_guard<std::mutex> lock(_registryMutex);
+            auto it = _registry.find(stream_id);
+            if (it == _registry.end() || it->second->finished)
+                return false;
+            it->second->isStillGoing = false;
+        }
+        printf("stream %zu: detached\n", stream_id);
+        reap();
+        return true;
+    }
+
+    // Hand a frame back: releases its surface and recycles the session of a finished stream
+    // with the last one. Frames must come back through here, not FrameInterface->Release.
+    void release(const DecodedFrame& frame) {
+        if (!frame.surface)
+            return;
+        frame.surface->FrameInterface->Release(frame.surface);
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        auto it = _registry.find(frame.stream_id);
+        if (it == _registry.end())
+            return;
+        Stream* s = it->second.get();
+        if (--s->outstanding == 0 && s->finished)
+            recycle_session(s);
+    }
+
+    // Streams still decoding
+    size_t stream_count() {
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        size_t count = 0;
+        for (auto& entry : _registry)
+            count += !entry.second->finished;
+        return count;
+    }
+
+    // NULL for system memory sessions
+    VADisplay get_context() {
+        return lvaDisplay;
+    }
+
+    // Total number of output frames of the indexed inputs, 0 when the inputs were not indexed
+    size_t get_frame_count() {
+        return _frameCount;
+    }
+
+    // Changes whenever a session closes its surface pools (detach) or sets up new ones (attach):
+    // surface IDs seen before may then belong to other surfaces. Read after popping a frame, a
+    // frame from a new pool is always popped after the change was made.
+    unsigned long long surface_generation() const {
+        return _surfaceGeneration.load(std::memory_order_acquire);
+    }
+
+    // Called with [first, last) for frame positions that never reach inference: pictures not decoded
+    // or not output, decimated and dropped frames, and the rest of a stream that ended early.
+    // Every position of a stream is either read() or skipped, so results can be put in frame order.
+    // Set before decoding(), it is called on the decode workers.
+    void set_skip_callback(std::function<void(mfxU64, mfxU64)> callback) {
+        _skipCallback = callback;
+    }
+
+    ~Decode_vpp() {
+        {
+            std::lock_guard<std::mutex> lock(_registryMutex);
+            for (auto& entry : _registry)
+                entry.second->isStillGoing = false;
+        }
+        // frames nobody will infer anymore are released so parked streams can finish
+        while (_running > 0) {
+            DecodedFrame frame;
+            if (_scheduler.try_pop(frame))
+                release(frame);
+            else
+                std::this_thread::yield();
+        }
+        _workers.reset();
+    }
+
+    void decoding() {
+        // every session is a task of the worker pool, a split input has several of them;
+        // with a placement the workers of a node only run the streams of that node
+        std::vector<size_t> groups;
+        std::vector<CpuList> cpus;
+        for (size_t i = 0; i < _decodeThreads; i++) {
+            groups.push_back(_placement.worker_group(i, _decodeThreads));
+            cpus.push_back(_placement.worker_cpus(i, _decodeThreads));
+        }
+        _workers.reset(new WorkStealingPool<Stream>(
+            _decodeThreads, "decode worker", [this](Stream* s) { return step(s); }, groups, cpus));
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        printf("Decoding %zu streams on %zu worker threads\n", _registry.size(), _workers->size());
+        print_placement(cpus);
+        _running = _registry.size();
+        _started = true;
+        for (auto& entry : _registry)
+            start_stream(entry.second.get());
+        // no stream could be initialized, inference gets the end of input right away
+        if (_running == 0)
+            _scheduler.close();
+    }
+
+    // Number of decoded frames of all streams waiting for inference
+    size_t queue_depth() {
+        return _scheduler.size();
+    }
+
+    // Frames dropped by the overflow policies so far
+    unsigned long long dropped_frames() {
+        return _scheduler.dropped();
+    }
+
+    // Share of the inferred frames, dropped frames and queueing delay of every stream
+    void print_schedule_summary() {
+        _scheduler.print_summary();
+    }
+
+    // Blocks for the next frame, streams take turns by their weights.
+    // A frame without surface means every stream has ended.
+    DecodedFrame read() {
+        DecodedFrame frame;
+        read_until(frame, std::chrono::steady_clock::time_point::max());
+        return frame;
+    }
+
+    // Same as read() but gives up at deadline, returns false if no frame arrived in time
+    bool read_until(DecodedFrame& frame, std::chrono::steady_clock::time_point deadline) {
+        if (_ended) {
+            frame = DecodedFrame();
+            return true;
+        }
+        bool ready = _scheduler.pop_until(frame, deadline);
+        if (ready && !frame.surface)
+            _ended = true;
+        return ready;
+    }
+
+   private:
+    // Everything of one input stream. Entries are allocated once and never move, the worker pool
+    // keeps its pointer while other streams are attached and detached around it.
+    struct Stream {
+        size_t id = 0;
+        std::string path;
+        std::unique_ptr<BitstreamSource> source;
+        mfxU64 firstFrame = 0;    // output position of the first frame of the source in its file
+        mfxU64 lastFrame = 0;     // position after its last frame, 0 when unknown (not indexed)
+        double inferFps = 0;      // frames per second handed to inference, 0 keeps every frame
+        double weight = 1.0;      // scheduling weight against the other streams
+        double keepRatio = 1.0;   // share of the decoded frames going to inference
+        double sourceFps = 30;
+        mfxU16 oriWidth = 0;      // decoded picture size
+        mfxU16 oriHeight = 0;
+        mfxSession session = NULL;
+        mfxBitstream bitstream = {};
+
+        // owned by the worker running the stream, the task is never run by two at once
+        std::atomic<bool> isStillGoing{true};
+        bool isDrainingDec = false;
+        bool isDrainingVPP = false;
+        mfxStatus status = MFX_ERR_NONE;
+        size_t group = 0;                    // worker group, the NUMA node with a placement
+        mfxFrameSurface1* decoded = NULL;    // decoder output VPP was too busy to take
+        mfxFrameSurface1* processed = NULL;  // VPP output not synchronized yet
+        std::chrono::steady_clock::time_point submitted;  // processed was handed to VPP
+        DecodedFrame ready;                  // synchronized frame waiting for room in its queue
+        FairScheduler<DecodedFrame>::Handle queue;  // pushed to without the lookup by id
+        mfxU64 frameIndex = 0;
+        mfxU64 accounted = 0;                // positions before it were read out or skipped
+        double credit = 1.0;                 // the first frame is always inferred
+        std::chrono::steady_clock::duration decodeTime{0};
+
+        // frames handed out and not released yet, incremented by the stream's worker;
+        // finished and recycled are guarded by _registryMutex
+        std::atomic<size_t> outstanding{0};
+        bool finished = false;
+        bool recycled = false;
+    };
+
+    // Register the streams of one input: a single one, or one per segment of an indexed input
+    void add_input_streams(const std::string& path,
+                           double inferFps,
+                           double weight,
+                           OverflowPolicy policy,
+                           int segments,
+                           std::vector<Stream*>& streams) {
+        std::shared_ptr<FileMapping> mapping;
+        std::shared_ptr<const HevcIndex> index;
+        if (_completeFrame || segments > 1) {
+            mapping = MapFile(path.c_str());
+            if (mapping)
+                index = LoadHevcIndex(path.c_str(), *mapping);
+            VERIFY(index, "Could not index input file, decoding it as a byte stream");
+        }
+
+        if (!index) {
+            // Map the input file, the decoder reads directly from the mapping
+            streams.push_back(
+                add_stream(path, OpenBitstreamSource(path.c_str(), BITSTREAM_BUFFER_SIZE), 0, inferFps, weight, policy));
+            return;
+        }
+
+        // every segment starts at an IDR and gets its own session sharing the VA display
+        std::vector<mfxU32> starts = SplitAtIdr(*index, (mfxU32)segments);
+        for (size_t j = 0; j < starts.size(); j++) {
+            mfxU32 end = (j + 1 < starts.size()) ? starts[j + 1] : 0;
+            std::unique_ptr<BitstreamSource> source(
+                new AccessUnitBitstreamSource(mapping, index, starts[j], end, _decodeMode));
+            // a segment starts at an IDR, its pictures are output at positions up to the next segment;
+            // bounds are output positions, pictures never output take none
+            mfxU32 first = index->FirstOutputFrom(starts[j]);
+            streams.push_back(add_stream(path, std::move(source), first, inferFps, weight, policy));
+            streams.back()->lastFrame = end ? index->FirstOutputFrom(end) : index->OutputCount();
+        }
+        _frameCount += index->OutputCount();
+    }
+
+    // Register one input stream under the next id, its session is created by init_stream()
+    Stream* add_stream(const std::string& path,
+                       std::unique_ptr<BitstreamSource> source,
+                       mfxU64 firstFrame,
+                       double inferFps,
+                       double weight,
+                       OverflowPolicy policy) {
+        VERIFY(source, "Could not open input file");
+        if (source && _prefetcher)
+            source->SetPrefetcher(_prefetcher.get());
+        std::unique_ptr<Stream> s(new Stream);
+        s->path = path;
+        s->source = std::move(source);
+        s->firstFrame = firstFrame;
+        s->frameIndex = firstFrame;
+        s->accounted = firstFrame;
+        s->inferFps = inferFps;
+        s->weight = weight;
+
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        s->id = _nextId++;
+        s->group = _placement.stream_group(s->id, _decodeThreads);
+        s->queue = _scheduler.add_stream(s->id, weight, policy);
+        Stream* stream = s.get();
+        _registry[stream->id] = std::move(s);
+        return stream;
+    }
+
+    // Set up the decode and VPP sessions of the streams, each stream on its own pool thread:
+    // header parsing and decoder/VPP initialization of one stream do not wait for the others
+    void init_streams(const std::vector<Stream*>& streams, size_t threads) {
+        size_t count = streams.size();
+        if (threads == 0)
+            threads = std::max<size_t>(1, std::min<size_t>(count, std::thread::hardware_concurrency()));
+
+        auto start = std::chrono::steady_clock::now();
+        std::unique_ptr<bool[]> ready(new bool[count]());
+        {
+            ThreadPool pool(threads);
+            for (size_t i = 0; i < count; i++)
+                pool.submit([this, &ready, &streams, i] {
+                    // first touch of the stream's host buffers happens on its node
+                    if (_placement.enabled())
+                        PinCurrentThread(_placement.group_cpus(streams[i]->group));
+                    ready[i] = init_stream(streams[i]);
+                });
+            pool.wait_idle();
+        }
+        printf("Initialized %zu streams on %zu threads in %.1f ms\n",
+               count,
+               threads,
+               std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+
+        // a stream that cannot be decoded is not scheduled, the others go on without it
+        for (size_t i = 0; i < count; i++) {
+            if (ready[i])
+                continue;
+            printf("Not able to initialize stream %zu (%s)\n", streams[i]->id, streams[i]->path.c_str());
+            drop_stream(streams[i]);
+        }
+    }
+
+    // Unregister a stream that never started, with its session
+    void drop_stream(Stream* s) {
+        std::unique_ptr<Stream> removed;
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        recycle_session(s);
+        _scheduler.remove_stream(s->id);
+        removed = std::move(_registry[s->id]);
+        _registry.erase(s->id);
+    }
+
+    // Create the decode and VPP session of one stream, only touches that stream.
+    // Returns false if the stream cannot be decoded.
+    bool init_stream(Stream* s) {
+        mfxStatus sts = MFX_ERR_NONE;
+        mfxVideoParam mfxDecParams = {};
+        mfxVideoParam mfxVPPParams = {};
+        mfxBitstream& bitstream = s->bitstream;
+        if (!s->source)
+            return false;
+
+        // Create VPL session, or reuse the one of a detached stream
+        mfxSession session = CreateStreamSession();
+        VERIFY(session != NULL, "Not able to create VPL session");
+        s->session = session;
+
+        //-- Initialize Decode
+        // Prepare input bitstream
+        bitstream.CodecId = MFX_CODEC_HEVC;
+
+        sts = s->source->Feed(bitstream);
+        VERIFY(MFX_ERR_NONE == sts, "Error reading bitstream");
+
+        // Retrieve the frame information from input stream
+        mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
+        mfxDecParams.IOPattern = _systemMemory ? MFX_IOPATTERN_OUT_SYSTEM_MEMORY : MFX_IOPATTERN_OUT_VIDEO_MEMORY;
+        sts = MFXVideoDECODE_DecodeHeader(session, &bitstream, &mfxDecParams);
+        VERIFY(MFX_ERR_NONE == sts, "Error decoding header");
+
+        // Original image size
+        s->oriWidth = mfxDecParams.mfx.FrameInfo.Width;
+        s->oriHeight = mfxDecParams.mfx.FrameInfo.Height;
+
+        // share of the decoded frames going on to VPP and inference
+        if (mfxDecParams.mfx.FrameInfo.FrameRateExtN && mfxDecParams.mfx.FrameInfo.FrameRateExtD)
+            s->sourceFps = (double)mfxDecParams.mfx.FrameInfo.FrameRateExtN / mfxDecParams.mfx.FrameInfo.FrameRateExtD;
+        s->keepRatio = s->inferFps > 0 && s->inferFps < s->sourceFps ? s->inferFps / s->sourceFps : 1.0;
+
+        // Input parameters finished, now initialize decode
+        sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+        VERIFY(MFX_ERR_NONE == sts, "Error initializing Decode");
+        if (sts != MFX_ERR_NONE)
+            return false;
+
+        //-- Initialize VPP
+        // Prepare vpp in/out params
+        // vpp in:  decode output image size
+        // vpp out: network model input size
+        mfxU16 vppInImgWidth = mfxDecParams.mfx.FrameInfo.Width;
+        mfxU16 vppInImgHeight = mfxDecParams.mfx.FrameInfo.Height;
+        mfxU16 vppOutImgWidth = inputDimWidth;
+        mfxU16 vppOutImgHeight = inputDimHeight;
+
+        mfxVPPParams.vpp.In.FourCC = mfxDecParams.mfx.FrameInfo.FourCC;
+        mfxVPPParams.vpp.In.ChromaFormat = mfxDecParams.mfx.FrameInfo.ChromaFormat;
+        mfxVPPParams.vpp.In.Width = vppInImgWidth;
+        mfxVPPParams.vpp.In.Height = vppInImgHeight;
+        mfxVPPParams.vpp.In.CropW = vppInImgWidth;
+        mfxVPPParams.vpp.In.CropH = vppInImgHeight;
+        mfxVPPParams.vpp.In.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+        mfxVPPParams.vpp.In.FrameRateExtN = 30;
+        mfxVPPParams.vpp.In.FrameRateExtD = 1;
+
+        mfxVPPParams.vpp.Out.FourCC = MFX_FOURCC_NV12;
+        mfxVPPParams.vpp.Out.ChromaFormat = MFX_CHROMAFORMAT_YUV420;
+        mfxVPPParams.vpp.Out.Width = ALIGN16(vppOutImgWidth);
+        mfxVPPParams.vpp.Out.Height = ALIGN16(vppOutImgHeight);
+        mfxVPPParams.vpp.Out.CropW = vppOutImgWidth;
+        mfxVPPParams.vpp.Out.CropH = vppOutImgHeight;
+        mfxVPPParams.vpp.Out.PicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+        mfxVPPParams.vpp.Out.FrameRateExtN = 30;
+        mfxVPPParams.vpp.Out.FrameRateExtD = 1;
+
+        mfxVPPParams.IOPattern = _systemMemory ? MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY
+                                               : MFX_IOPATTERN_IN_VIDEO_MEMORY | MFX_IOPATTERN_OUT_VIDEO_MEMORY;
+
+        // Initialize the VPP, its output pool holds the frames queued and in flight
+        sts = InitVPPWithOutputPool(session, &mfxVPPParams, (mfxU32)_outputPool);
+        VERIFY(MFX_ERR_NONE == sts, "Error initializing VPP");
+        return sts == MFX_ERR_NONE;
+    }
+
+    // Close decode and VPP of a finished stream whose frames all came back, the session keeps
+    // its VA display and goes to the free list. Called with _registryMutex held.
+    void recycle_session(Stream* s) {
+        if (s->recycled)
+            return;
+        s->recycled = true;
+        if (!s->session)
+            return;
+        // before the surfaces are freed, IDs handed out again afterwards are never taken for the old ones
+        _surfaceGeneration.fetch_add(1, std::memory_order_acq_rel);
+        MFXVideoDECODE_Close(s->session);
+        MFXVideoVPP_Close(s->session);
+        std::lock_guard<std::mutex> lock(_sessionMutex);
+        _freeSessions.push_back(s->session);
+        s->session = NULL;
+    }
+
+    // Drop the streams whose session was recycled
+    void reap() {
+        std::vector<std::unique_ptr<Stream>> done;
+        {
+            std::lock_guard<std::mutex> lock(_registryMutex);
+            for (auto it = _registry.begin(); it != _registry.end();) {
+                if (it->second->recycled) {
+                    done.push_back(std::move(it->second));
+                    it = _registry.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+    }
+
+    // The task of a stream has run its last step
+    void finish_stream(Stream* s) {
+        _scheduler.remove_stream(s->id);
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        s->finished = true;
+        if (s->outstanding == 0)
+            recycle_session(s);
+    }
+
+    void start_stream(Stream* s) {
+        _workers->submit(s, s->group);
+    }
+
+    // Report the CPUs of every decode worker and the node of every stream, called with _registryMutex held
+    void print_placement(const std::vector<CpuList>& cpus) {
+        if (!_placement.enabled())
+            return;
+        printf("Placement %s: %zu NUMA nodes, decode workers on %zu of them\n",
+               _placement.policy == PLACEMENT_CORE ? "core" : "node",
+               _placement.topology.nodes.size(),
+               _placement.groups(_decodeThreads));
+        for (size_t i = 0; i < cpus.size(); i++)
+            printf("decode worker %zu: node %d, cpus %s\n",
+                   i,
+                   _placement.node_id(_placement.worker_group(i, _decodeThreads)),
+                   FormatCpuList(cpus[i]).c_str());
+        for (size_t group = 0; group < _placement.groups(_decodeThreads); group++) {
+            std::string ids;
+            for (auto& entry : _registry)
+                if (entry.second->group == group)
+                    ids += (ids.empty() ? "" : ",") + std::to_string(entry.first);
+            printf("streams on node %d: %s\n", _placement.node_id(group), ids.empty() ? "none" : ids.c_str());
+        }
+    }
+
+    // A pop made room in the queue of a stream parked on it
+    void resume(size_t stream_id) {
+        Stream* s = NULL;
+        {
+            std::lock_guard<std::mutex> lock(_registryMutex);
+            auto it = _registry.find(stream_id);
+            if (it != _registry.end())
+                s = it->second.get();
+        }
+        if (s)
+            _workers->submit(s, s->group);
+    }
+
+    // One cooperative step of a stream on a decode worker: a read/decode/VPP round, a check of
+    // the pending sync or the hand-over of a synchronized frame. The device is never waited on,
+    // a busy device or an unfinished sync yields to the other streams of the worker, a full
+    // queue of a blocking stream parks it until resume(). After a park the task may already run
+    // on another worker, s is not touched anymore.
+    TaskResult step(Stream* s) {
+        if (!s->ready.surface) {
+            auto start = std::chrono::steady_clock::now();
+            TaskResult result = decode_step(s);
+            s->decodeTime += std::chrono::steady_clock::now() - start;
+            if (result == TASK_DONE) {
+                end_stream(s);
+                return TASK_DONE;
+            }
+            if (!s->ready.surface)
+                return result;
+        }
+
+        // a full queue of this stream parks or drops a frame by the stream's policy, the other streams go on
+        TraceScope pushScope("queue_push", s->ready.frame_index);
+        DecodedFrame dropped;
+        PushResult pushed = _scheduler.try_push(s->queue, s->ready, &dropped);
+        if (pushed == PUSH_FULL)
+            return TASK_PARK;
+        s->ready = DecodedFrame();
+        if (pushed == PUSH_DROPPED) {
+            if (_skipCallback)
+                _skipCallback(dropped.frame_index, dropped.frame_index + 1);
+            release(dropped);
+        }
+        return TASK_PROGRESS;
+    }
+
+    // Positions of the stream up to position will not be read out
+    void skip_until(Stream* s, mfxU64 position) {
+        if (position <= s->accounted)
+            return;
+        if (_skipCallback)
+            _skipCallback(s->accounted, position);
+        s->accounted = position;
+    }
+
+    // Decode part of step(), leaves a synchronized frame in s->ready
+    TaskResult decode_step(Stream* s) {
+        if (s->processed) {
+            s->status = s->processed->FrameInterface->Synchronize(s->processed, 0);
+            if (s->status == MFX_WRN_IN_EXECUTION)
+                return TASK_YIELD;
+            auto synced = std::chrono::steady_clock::now();
+            if (Metrics::Get().enabled())
+                Metrics::Get().record(METRIC_SYNC, synced - s->submitted);
+            if (Trace::Get().enabled())
+                Trace::Get().record(kMetricStageNames[METRIC_SYNC], s->submitted, synced, (long long)s->frameIndex);
+            VERIFY(MFX_ERR_NONE == s->status, "MFXVideoCORE_SyncOperation error");
+
+            // wrap the VPP output, stream id and frame position into a shared surface queue
+            // indexed sources stamp every picture with its position, decoder and VPP pass it on
+            if (s->source->HasFrameIndex())
+                s->frameIndex = s->processed->Data.TimeStamp;
+            // pictures are output in order, positions passed over were not decoded or not output
+            skip_until(s, s->frameIndex);
+            s->accounted = std::max(s->accounted, s->frameIndex + 1);
+            s->ready = {s->processed,
+                        s->id,
+                        s->frameIndex,
+                        s->frameIndex * 1000 / s->sourceFps,
+                        synced,
+                        s->oriHeight,
+                        s->oriWidth};
+            s->processed = NULL;
+            s->frameIndex++;
+            s->outstanding++;
+            return TASK_PROGRESS;
+        }
+        if (!s->isStillGoing)
+            return TASK_DONE;
+
+        if (!s->decoded) {
+            if (s->isDrainingDec == false){
+                MetricScope readScope(METRIC_READ);
+                s->status = s->source->Feed(s->bitstream);
+                VERIFY(MFX_ERR_NONE == s->status, "Error reading bitstream");
+                if (s->status != MFX_ERR_NONE)
+                    s->isDrainingDec = true;
+            }
+
+            if (!s->isDrainingVPP){
+                MetricScope decodeScope(METRIC_DECODE);
+                mfxSyncPoint syncp = {};
+                s->status = MFXVideoDECODE_DecodeFrameAsync(s->session,
+                                                            (s->isDrainingDec) ? NULL : &s->bitstream,
+                                                            NULL,
+                                                            &s->decoded,
+                                                            &syncp);
+            }
+            else{
+                s->status = MFX_ERR_NONE;
+            }
+
+            switch (s->status){
+            case MFX_ERR_NONE:
+                break;
+            case MFX_ERR_MORE_DATA:
+                // The function requires more bitstream at input, the next step reads it
+                if (s->isDrainingDec)
+                    s->isDrainingVPP = true;
+                return TASK_PROGRESS;
+            case MFX_WRN_DEVICE_BUSY:
+                return TASK_YIELD;
+            default:
+                // a decode error ends the stream, retrying would fail the same way forever
+                if (s->status < 0) {
+                    printf("stream %zu: decode error %d\n", s->id, s->status);
+                    s->isStillGoing = false;
+                    return TASK_DONE;
+                }
+                return TASK_PROGRESS;
+            }
+
+            if (s->decoded) {
+                // decimation: a frame is kept once the credit of the skipped ones adds up to a whole frame,
+                // the others go back to the decoder without being scaled
+                if (s->credit < 1.0 - 1e-9) {
+                    s->credit += s->keepRatio;
+                    if (s->source->HasFrameIndex())
+                        s->frameIndex = s->decoded->Data.TimeStamp;
+                    skip_until(s, ++s->frameIndex);
+                    s->decoded->FrameInterface->Release(s->decoded);
+                    s->decoded = NULL;
+                    return TASK_PROGRESS;
+                }
+                s->credit += s->keepRatio - 1.0;
+            }
+        }
+
+        mfxFrameSurface1* pmfxVPPSurfacesOut = NULL;
+        {
+            MetricScope vppScope(METRIC_VPP);
+            s->status = MFXVideoVPP_ProcessFrameAsync(s->session, s->decoded, &pmfxVPPSurfacesOut);
+        }
+        // the decoded frame is kept for the next try
+        if (s->status == MFX_WRN_DEVICE_BUSY)
+            return TASK_YIELD;
+        // VPP holds its own reference to the input surface
+        if (s->decoded) {
+            s->decoded->FrameInterface->Release(s->decoded);
+            s->decoded = NULL;
+        }
+        if (s->status == MFX_ERR_NONE) {
+            // synchronized by a later step, the worker goes on with the other streams meanwhile
+            s->processed = pmfxVPPSurfacesOut;
+            s->submitted = std::chrono::steady_clock::now();
+        }
+        else if (s->status == MFX_ERR_MORE_DATA) {
+            if (s->isDrainingVPP == true)
+                s->isStillGoing = false;
+        }
+        else if (s->status < 0) {
+            s->isStillGoing = false;
+        }
+        return TASK_PROGRESS;
+    }
+
+    // Last step of a stream, s may be gone once it returns
+    void end_stream(Stream* s) {
+        size_t stream_id = s->id;
+        s->isStillGoing = false;
+        if (s->decoded) {
+            s->decoded->FrameInterface->Release(s->decoded);
+            s->decoded = NULL;
+        }
+        skip_until(s, s->lastFrame);
+        // time blocked on input data is reported apart from decode/VPP time
+        printf("stream %zu: decode %.2f ms, I/O stall %.2f ms\n",
+               stream_id,
+               std::chrono::duration<double, std::milli>(s->decodeTime).count(),
+               s->source->GetStallNs() / 1e6);
+        finish_stream(s);
+
+        // the last stream to finish marks the end of all input
+        if (--_running == 0) {
+            printf("Decode workers: %zu threads, %llu stream steps stolen\n", _workers->size(), _workers->steals());
+            _scheduler.close();
+        }
+    }
+
+    // Loader with the implementation filters, shared by the sessions of all streams
+    mfxLoader CreateVPLLoader() {
+        mfxStatus sts = MFX_ERR_NONE;
+
+        // variables used only in 2.x version
+        mfxConfig cfg[4];
+        mfxVariant cfgVal;
+
+        mfxLoader loader = MFXLoad();
+        VERIFY2(NULL != loader, "MFXLoad failed -- is implementation in path?\n");
+
+        // Implementation used must be the hardware implementation, or the CPU runtime for system memory
+        cfg[0] = MFXCreateConfig(loader);
+        VERIFY2(NULL != cfg[0], "MFXCreateConfig failed")
+        cfgVal.Type = MFX_VARIANT_TYPE_U32;
+        cfgVal.Data.U32 = _systemMemory ? MFX_IMPL_TYPE_SOFTWARE : MFX_IMPL_TYPE_HARDWARE;
+        sts = MFXSetConfigFilterProperty(cfg[0], (mfxU8*)"mfxImplDescription.Impl", cfgVal);
+        VERIFY2(MFX_ERR_NONE == sts, "MFXSetConfigFilterProperty failed for Impl");
+
+        // Implementation must provide an HEVC decoder
+        cfg[1] = MFXCreateConfig(loader);
+        VERIFY2(NULL != cfg[1], "MFXCreateConfig failed")
+        cfgVal.Type = MFX_VARIANT_TYPE_U32;
+        cfgVal.Data.U32 = MFX_CODEC_HEVC;
+        sts = MFXSetConfigFilterProperty(
+            cfg[1],
+            (mfxU8*)"mfxImplDescription.mfxDecoderDescription.decoder.CodecID",
+            cfgVal);
+        VERIFY2(MFX_ERR_NONE == sts, "MFXSetConfigFilterProperty failed for decoder CodecID");
+
+        // Implementation used must have VPP scaling capability
+        cfg[2] = MFXCreateConfig(loader);
+        VERIFY2(NULL != cfg[2], "MFXCreateConfig failed")
+        cfgVal.Type = MFX_VARIANT_TYPE_U32;
+        cfgVal.Data.U32 = MFX_EXTBUFF_VPP_SCALING;
+        sts = MFXSetConfigFilterProperty(
+            cfg[2],
+            (mfxU8*)"mfxImplDescription.mfxVPPDescription.filter.FilterFourCC",
+            cfgVal);
+        VERIFY2(MFX_ERR_NONE == sts, "MFXSetConfigFilterProperty failed for VPP scale");
+
+        // Implementation used must provide API version 2.2 or newer
+        cfg[3] = MFXCreateConfig(loader);
+        VERIFY2(NULL != cfg[3], "MFXCreateConfig failed")
+        cfgVal.Type = MFX_VARIANT_TYPE_U32;
+        cfgVal.Data.U32 = VPLVERSION(MAJOR_API_VERSION_REQUIRED, MINOR_API_VERSION_REQUIRED);
+        sts = MFXSetConfigFilterProperty(cfg[3],
+                                         (mfxU8*)"mfxImplDescription.ApiVersion.Version",
+                                         cfgVal);
+        VERIFY2(MFX_ERR_NONE == sts, "MFXSetConfigFilterProperty failed for API version");
+
+        // Print info about implementation loaded, once for all streams
+        ShowImplementationInfo(loader, 0);
+        return loader;
+    }
+
+    // Initialized VA display shared by every session, NULL if the render node cannot be opened
+    static VADisplay OpenVADisplay() {
+        int fd = open("/dev/dri/renderD128", O_RDWR);
+        if (fd < 0)
+            return NULL;
+        VADisplay va_dpy = vaGetDisplayDRM(fd);
+        if (!va_dpy)
+            return NULL;
+        int major_version = 0, minor_version = 0;
+        if (VA_STATUS_SUCCESS != vaInitialize(va_dpy, &major_version, &minor_version))
+            return NULL;
+        return va_dpy;
+    }
+
+    // Session of one stream on the shared loader, called from the init pool threads.
+    // A recycled session is taken first, it already has the VA display.
+    mfxSession CreateStreamSession() {
+        mfxStatus sts = MFX_ERR_NONE;
+        mfxSession session = NULL;
+        {
+            // the dispatcher does not promise a thread safe loader
+            std::lock_guard<std::mutex> lock(_sessionMutex);
+            if (!_freeSessions.empty()) {
+                session = _freeSessions.back();
+                _freeSessions.pop_back();
+                return session;
+            }
+            sts = MFXCreateSession(_loader, 0, &session);
+        }
+        VERIFY2(MFX_ERR_NONE == sts,
+                "Cannot create session -- no implementations meet selection criteria");
+
+        // share one vaapi device handle amonge different input source, the CPU runtime needs none
+        if (!_systemMemory) {
+            sts = MFXVideoCORE_SetHandle(session,
+                                         static_cast<mfxHandleType>(MFX_HANDLE_VA_DISPLAY),
+                                         lvaDisplay);
+            VERIFY(MFX_ERR_NONE == sts, "SetHandle error");
+        }
+        return session;
+    }
+
+    FairScheduler<DecodedFrame> _scheduler;
+    std::map<size_t, std::unique_ptr<Stream>> _registry;  // attached streams by id, ids are never reused
+    std::mutex _registryMutex;
+    size_t _nextId = 0;
+    bool _started = false;            // decoding() started the decode workers
+    std::atomic<size_t> _running{0};  // streams that have not finished yet
+    bool _ended = false;              // the end of input was read from the queue
+    std::unique_ptr<Prefetcher> _prefetcher;
+    bool _completeFrame = false;
+    HevcDecodeMode _decodeMode = HEVC_DECODE_ALL;
+    size_t _frameCount = 0;
+    std::function<void(mfxU64, mfxU64)> _skipCallback;
+    std::atomic<unsigned long long> _surfaceGeneration{0};
+    size_t width;
+    size_t height;
+
+    bool isNetworkLoaded = false;
+    mfxU16 inputDimWidth, inputDimHeight;
+    mfxLoader _loader = NULL;
+    std::mutex _sessionMutex;
+    std::vector<mfxSession> _freeSessions;  // sessions of detached streams, decode and VPP closed
+    VADisplay lvaDisplay = NULL;
+    bool _systemMemory = false;
+    size_t _outputPool = 0;
+    size_t _decodeThreads = 1;
+    ThreadPlacement _placement;
+    std::unique_ptr<WorkStealingPool<Stream>> _workers;  // declared last, its threads are gone before the streams
+};
+}  // namespace multi_source
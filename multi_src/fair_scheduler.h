@@ -0,0 +1,374 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+#include "mpmc_queue.h"
+#include "utils/metrics.h"
+
+namespace multi_source {
+// What push() does with a frame for a full stream queue
+enum OverflowPolicy {
+    OVERFLOW_BLOCK,        // the producer waits for room, nothing is lost (files)
+    OVERFLOW_DROP_OLDEST,  // the oldest queued frame makes room, the freshest frames are inferred (live cameras)
+    OVERFLOW_DROP_NEWEST,  // the new frame is dropped, queued frames keep their place
+};
+
+// What try_push() did with a frame
+enum PushResult {
+    PUSH_QUEUED,
+    PUSH_DROPPED,  // a frame was dropped by the overflow policy, the caller releases it
+    PUSH_FULL,     // the queue of a blocking stream is full, nothing was queued
+};
+
+// Parse "block", "drop_oldest" or "drop_newest", returns false for anything else
+inline bool ParseOverflowPolicy(const std::string& name, OverflowPolicy* policy) {
+    if (name == "block")
+        *policy = OVERFLOW_BLOCK;
+    else if (name == "drop_oldest")
+        *policy = OVERFLOW_DROP_OLDEST;
+    else if (name == "drop_newest")
+        *policy = OVERFLOW_DROP_NEWEST;
+    else
+        return false;
+    return true;
+}
+
+// Bounded queue per stream, drained by deficit round robin: every round a stream may hand out
+// up to its weight in frames, the unused part of a fractional weight carries over to its next round.
+// A fast stream only fills its own queue and cannot crowd a slow one out of the batches.
+// The frames of every stream sit in their own MpmcQueue: a producer pushing to a queue that
+// already has frames and room takes no lock. The mutex guards the round robin bookkeeping
+// (active streams, deficits), which is touched by pops, by a push to an empty queue and by
+// producers that wait, park or evict on a full queue.
+// T is a DecodedFrame or anything else with a queued time point, a default T marks the end of input.
+template <typename T>
+class FairScheduler {
+   public:
+    struct Queue;
+    // A stream's queue, push() through it skips the lookup by id
+    typedef std::shared_ptr<Queue> Handle;
+
+    explicit FairScheduler(size_t capacity) : _capacity(capacity > 0 ? capacity : 1) {}
+
+    // weight is the share of the stream relative to the others, 1 for equal shares
+    Handle add_stream(size_t id, double weight = 1.0, OverflowPolicy policy = OVERFLOW_BLOCK) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        Handle& queue = _queues[id];
+        if (!queue) {
+            // the ring positions of the queue are cache line aligned, which plain new does not honor in C++11
+            void* memory = nullptr;
+            if (posix_memalign(&memory, MPMC_CACHE_LINE, sizeof(Queue)) != 0)
+                throw std::bad_alloc();
+            queue = Handle(new (memory) Queue(id, _capacity), [](Queue* q) {
+                q->~Queue();
+                free(q);
+            });
+        }
+        queue->weight = weight > 0 ? weight : 1.0;
+        queue->policy = policy;
+        queue->removed = false;
+        return queue;
+    }
+
+    // The stream pushes nothing more, its queue goes away once the frames left in it were popped
+    void remove_stream(size_t id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _queues.find(id);
+        if (it == _queues.end())
+            return;
+        Queue* queue = it->second.get();
+        queue->removed = true;
+        queue->room.notify_all();
+        if (queue->queued.load() == 0 && !queue->active)
+            retire(queue);
+    }
+
+    // Queue value for stream id. A full queue is handled by the policy of the stream: block until
+    // there is room, evict the oldest frame or drop value. Returns true with the frame that was not
+    // queued in dropped, the caller releases it; value of an unknown stream is dropped as well.
+    bool push(size_t id, const T& value, T* dropped) {
+        return push(find(id), value, dropped);
+    }
+
+    bool push(const Handle& queue, const T& value, T* dropped) {
+        return enqueue(queue, value, dropped, true) == PUSH_DROPPED;
+    }
+
+    // Same as push() but never waits: a blocking stream with a full queue gets PUSH_FULL and
+    // the room callback with its id once a pop frees a slot, so a cooperative producer can
+    // park instead of holding its thread
+    PushResult try_push(size_t id, const T& value, T* dropped) {
+        return try_push(find(id), value, dropped);
+    }
+
+    PushResult try_push(const Handle& queue, const T& value, T* dropped) {
+        return enqueue(queue, value, dropped, false);
+    }
+
+    // Called without the lock held, from the thread popping the frame
+    void set_room_callback(std::function<void(size_t id)> on_room) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _onRoom = on_room;
+    }
+
+    // Every stream has ended, pop returns the end marker once the queues are empty
+    void close() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _ready.notify_all();
+    }
+
+    // Next frame in deficit round robin order, waiting no longer than deadline;
+    // returns false if nothing arrived in time
+    bool pop_until(T& value, std::chrono::steady_clock::time_point deadline) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto ready = [this] { return !_active.empty() || _closed; };
+        if (deadline == std::chrono::steady_clock::time_point::max())
+            _ready.wait(lock, ready);
+        else if (!_ready.wait_until(lock, deadline, ready))
+            return false;
+        if (_active.empty()) {
+            value = T();
+            return true;
+        }
+
+        // the stream at the front keeps serving until its deficit is spent, then goes to the back
+        Queue* queue;
+        for (;;) {
+            queue = _active.front().get();
+            if (!queue->inRound) {
+                queue->deficit += queue->weight;
+                queue->inRound = true;
+            }
+            if (queue->deficit >= 1.0)
+                break;
+            queue->inRound = false;
+            _active.push_back(std::move(_active.front()));
+            _active.pop_front();
+        }
+        // an active queue has a published frame, but the cell at the head may belong to a producer
+        // that took it earlier and is still copying its frame in
+        while (!queue->frames.try_pop(value))
+            std::this_thread::yield();
+        queue->deficit -= 1.0;
+        queue->popped++;
+        _popped++;
+        _size.fetch_sub(1, std::memory_order_relaxed);
+        queue->wait.record((unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - value.queued)
+                               .count());
+        bool empty = queue->queued.fetch_sub(1) == 1;
+        queue->reserved.fetch_sub(1);
+        if (queue->waiting > 0)
+            queue->room.notify_one();
+        bool parked = queue->parked;
+        size_t id = queue->id;
+        queue->parked = false;
+        if (empty) {
+            // an idle stream does not bank credit for later
+            queue->deficit = 0;
+            queue->inRound = false;
+            queue->active = false;
+            if (queue->removed)
+                retire(queue);
+            _active.pop_front();
+        }
+        if (parked && _onRoom) {
+            std::function<void(size_t)> on_room = _onRoom;
+            lock.unlock();
+            on_room(id);
+        }
+        return true;
+    }
+
+    bool try_pop(T& value) {
+        return pop_until(value, std::chrono::steady_clock::now());
+    }
+
+    size_t size() {
+        return _size.load(std::memory_order_relaxed);
+    }
+
+    // Frames dropped by the overflow policies of all streams
+    unsigned long long dropped() {
+        return _dropped.load(std::memory_order_relaxed);
+    }
+
+    // Share of the popped frames and queueing delay of every stream, removed ones included
+    void print_summary() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<StreamSummary> streams = _retired;
+        for (auto& entry : _queues)
+            streams.push_back(summarize(entry.first, *entry.second));
+        std::sort(streams.begin(), streams.end(), [](const StreamSummary& a, const StreamSummary& b) {
+            return a.id < b.id;
+        });
+        for (auto& stream : streams)
+            printf("stream %zu: weight %.2f, %llu frames (%.1f%% share), %llu dropped, queue wait p50 %.2f ms, p99 %.2f ms\n",
+                   stream.id,
+                   stream.weight,
+                   stream.popped,
+                   _popped ? 100.0 * stream.popped / _popped : 0.0,
+                   stream.dropped,
+                   stream.p50_ms,
+                   stream.p99_ms);
+    }
+
+    struct Queue {
+        Queue(size_t id, size_t capacity) : id(id), frames(capacity) {}
+
+        size_t id;
+        MpmcQueue<T> frames;               // may be larger than the capacity, reserved keeps the bound
+        std::atomic<size_t> reserved{0};   // slots taken by producers, at most the capacity
+        std::atomic<size_t> queued{0};     // frames published in frames, the queue is active while above 0
+        std::atomic<bool> removed{false};
+        std::atomic<unsigned long long> dropped{0};
+        double weight = 1.0;
+        OverflowPolicy policy = OVERFLOW_BLOCK;
+        // under _mutex
+        std::condition_variable room;  // producers waiting for a free slot
+        int waiting = 0;
+        double deficit = 0;
+        bool inRound = false;  // the weight of the current round was added
+        bool active = false;   // in _active
+        bool parked = false;   // a try_push() found the queue full
+        unsigned long long popped = 0;
+        LatencyHistogram wait;
+    };
+
+   private:
+    struct StreamSummary {
+        size_t id;
+        double weight;
+        unsigned long long popped;
+        unsigned long long dropped;
+        double p50_ms;
+        double p99_ms;
+    };
+
+    static StreamSummary summarize(size_t id, const Queue& queue) {
+        LatencySummary wait;
+        wait.add(queue.wait);
+        return {id,
+                queue.weight,
+                queue.popped,
+                queue.dropped.load(),
+                wait.percentile_ns(50) / 1e6,
+                wait.percentile_ns(99) / 1e6};
+    }
+
+    Handle find(size_t id) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto it = _queues.find(id);
+        return it == _queues.end() ? Handle() : it->second;
+    }
+
+    // Take a slot of the stream's capacity
+    bool reserve(const Handle& queue) {
+        size_t reserved = queue->reserved.load();
+        while (reserved < _capacity)
+            if (queue->reserved.compare_exchange_weak(reserved, reserved + 1))
+                return true;
+        return false;
+    }
+
+    void count_drop(const Handle& queue) {
+        queue->dropped.fetch_add(1, std::memory_order_relaxed);
+        _dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    PushResult enqueue(const Handle& queue, const T& value, T* dropped, bool wait) {
+        if (!queue || queue->removed) {
+            *dropped = value;
+            return PUSH_DROPPED;
+        }
+        if (!reserve(queue)) {
+            if (queue->policy == OVERFLOW_DROP_NEWEST) {
+                count_drop(queue);
+                *dropped = value;
+                return PUSH_DROPPED;
+            }
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (queue->policy == OVERFLOW_DROP_OLDEST) {
+                // the oldest frame makes way for value, pops are excluded by the lock
+                count_drop(queue);
+                if (!queue->frames.try_pop(*dropped)) {
+                    *dropped = value;
+                    return PUSH_DROPPED;
+                }
+                queue->frames.try_push(value);
+                return PUSH_DROPPED;
+            }
+            if (!wait) {
+                // a pop may have made room since the check above, it only reports parked queues
+                if (!reserve(queue)) {
+                    queue->parked = true;
+                    return PUSH_FULL;
+                }
+            } else {
+                queue->waiting++;
+                queue->room.wait(lock, [&] { return queue->removed || reserve(queue); });
+                queue->waiting--;
+                if (queue->removed) {
+                    *dropped = value;
+                    return PUSH_DROPPED;
+                }
+            }
+        }
+
+        // a reserved slot is always free in frames: pops release the slot after the cell
+        queue->frames.try_push(value);
+        _size.fetch_add(1, std::memory_order_relaxed);
+        if (queue->queued.fetch_add(1) == 0) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (!queue->active) {
+                queue->active = true;
+                _active.push_back(queue);
+            }
+            _ready.notify_one();
+        }
+        return PUSH_QUEUED;
+    }
+
+    // only the summary of a removed stream is kept, not its histogram; a frame pushed after the
+    // removal keeps the queue alive in _active until it is popped, and is not counted twice
+    void retire(Queue* queue) {
+        auto it = _queues.find(queue->id);
+        if (it == _queues.end() || it->second.get() != queue)
+            return;
+        _retired.push_back(summarize(it->first, *it->second));
+        _queues.erase(it);
+    }
+
+    size_t _capacity;
+    std::mutex _mutex;
+    std::condition_variable _ready;  // consumer waiting for a frame
+    std::map<size_t, Handle> _queues;
+    std::deque<Handle> _active;  // streams with queued frames, in round robin order
+    std::vector<StreamSummary> _retired;
+    std::atomic<size_t> _size{0};
+    unsigned long long _popped = 0;
+    std::atomic<unsigned long long> _dropped{0};
+    bool _closed = false;
+    std::function<void(size_t)> _onRoom;
+};
+}  // namespace multi_source
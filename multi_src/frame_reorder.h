@@ -0,0 +1,69 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace multi_source {
+// Holds per-frame output that arrives out of order (e.g. from parallel segments
+// of one file) and prints it as soon as all earlier frames have been printed or skipped
+class FrameReorderBuffer {
+   public:
+    void push(unsigned long long frame_index, std::string text) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _pending[frame_index] = std::move(text);
+        print_ready();
+    }
+
+    // frames [first, last) will never be pushed (not decoded, decimated, dropped or failed)
+    void skip(unsigned long long first, unsigned long long last) {
+        if (last <= first)
+            return;
+        std::unique_lock<std::mutex> lock(_mutex);
+        unsigned long long& end = _skipped[first];
+        end = std::max(end, last);
+        print_ready();
+    }
+
+    // print whatever is left, frames that were never inferred are skipped
+    void flush() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (auto& entry : _pending) {
+            fputs(entry.second.c_str(), stdout);
+            _next = entry.first + 1;
+        }
+        _pending.clear();
+        _skipped.clear();
+    }
+
+   private:
+    // print from _next on until a frame is missing, called with _mutex held
+    void print_ready() {
+        for (;;) {
+            if (!_pending.empty() && _pending.begin()->first <= _next) {
+                fputs(_pending.begin()->second.c_str(), stdout);
+                _next = std::max(_next, _pending.begin()->first + 1);
+                _pending.erase(_pending.begin());
+            } else if (!_skipped.empty() && _skipped.begin()->first <= _next) {
+                _next = std::max(_next, _skipped.begin()->second);
+                _skipped.erase(_skipped.begin());
+            } else {
+                break;
+            }
+        }
+    }
+
+    std::map<unsigned long long, std::string> _pending;
+    std::map<unsigned long long, unsigned long long> _skipped;  // first to last of every skipped range
+    unsigned long long _next = 0;
+    std::mutex _mutex;
+};
+}  // namespace multi_source
@@ -12,15 +12,25 @@
 /// @file
 
 #include <gflags/gflags.h>
+#include <algorithm>
 #include <chrono>
+#include <condition_variable>
 #include <iostream>
 #include <memory>
 #include <openvino/openvino.hpp>
 #include <openvino/runtime/intel_gpu/properties.hpp>
 #include <thread>
+#include "batcher.h"
 #include "blocking_queue.h"
 #include "decode_vpp.h"
+#include "frame_reorder.h"
+#include "utils/cpu_topology.h"
 #include "utils/functions.h"
+#include "utils/metrics.h"
+#include "utils/model_cache.h"
+#include "utils/remote_tensor_cache.h"
+#include "utils/thread_pool.h"
+#include "utils/trace.h"
 #include "utils/util.h"
 
 using namespace multi_source;
@@ -28,24 +38,86 @@ DEFINE_string(i, "",
               "Required. Path to one or multiple input video files "
               "(separated by comma or delimeter specified in -delimeter option");
 DEFINE_string(m, "", "Required. Path to IR .xml file");
-// DEFINE_string(device, "GPU", "Device for decode and inference, 'CPU' or 'GPU'");
+DEFINE_string(device, "GPU", "Device for decode and inference, 'CPU' or 'GPU'");
 DEFINE_int32(bs, 2, "Batch size");
+DEFINE_double(max_wait_ms, 0, "Dispatch a partial batch once its oldest frame has waited this long, 0 waits for full batches");
 DEFINE_int32(nr, 4, "Number of inference requests");
 DEFINE_int32(ns, 1, "Number of GPU streams");
+DEFINE_int32(pp_threads, 2, "Number of threads printing inference results and releasing surfaces");
 DEFINE_int32(fr, 30, "Number of frame to be decoded for each input source");
+DEFINE_string(infer_fps, "", "Frames per second inferred for each input (separated by comma), a single value applies to all inputs, 0 infers every frame");
+DEFINE_bool(complete_frame, false, "Index the inputs and submit whole frames to the decoder");
+DEFINE_int32(segments, 1, "Split a single input at IDR frames and decode the segments in parallel sessions");
+DEFINE_int32(prefetch_mb, 8, "Megabytes of each input read ahead of its decoder, 0 disables the read-ahead");
+DEFINE_int32(io_threads, 2, "Number of I/O threads shared by all inputs for the read-ahead");
+DEFINE_int32(init_threads, 0, "Number of threads initializing the decode and VPP sessions, 0 uses one per stream up to the core count");
+DEFINE_int32(decode_threads, 0, "Number of worker threads decoding all streams, 0 uses the core count");
+DEFINE_string(placement, "none", "Thread placement: 'none' leaves threads unpinned, 'node' pins the decode workers of each stream group to a NUMA node, 'core' pins every decode worker to a CPU of its node");
+DEFINE_int32(infer_node, 0, "NUMA node of the batching loop, infer completion and postprocessing threads when -placement is not none");
+DEFINE_bool(count_frames, false, "Print the number of frames of each input from its index and exit");
+DEFINE_string(metrics, "", "Export per-stage latency histograms, stream FPS and queue depths: '-' prints JSON lines, otherwise path of a Prometheus text file");
+DEFINE_int32(metrics_interval_ms, 1000, "Interval of the -metrics export");
+DEFINE_string(decode_mode, "all", "Pictures to decode: 'all', 'ref' (skip non-reference pictures) or 'key' (IDR/CRA/BLA only)");
+DEFINE_string(cache_dir, "", "Directory of the OpenVINO compiled model cache (ov::cache_dir), empty disables it");
+DEFINE_string(blob_dir, "", "Directory to export the compiled model to and import it from on the next run, keyed by model, device, batch size, streams and preprocessing");
+DEFINE_string(report_json, "", "Write frames/s, frame latency percentiles and peak RSS of the run as JSON to this path");
+DEFINE_int32(queue_size, STREAM_QUEUE_SIZE, "Decoded frames each stream may have waiting for inference");
+DEFINE_string(weights, "", "Scheduling weight of each input, separated by comma, a single value applies to all inputs; batches take frames of the inputs in proportion to their weights");
+DEFINE_string(overflow, "block", "What a stream does when its queue is full, separated by comma per input, a single value applies to all: 'block' waits, 'drop_oldest' or 'drop_newest' drop a frame (live cameras)");
+DEFINE_string(hotplug, "", "Streams attached and detached while running, comma separated: '+<path>@<ms>' attaches, '-<stream id>@<ms>' detaches");
+DEFINE_string(yolo_anchors, YOLO_DEFAULT_ANCHORS, "Anchors of a YOLO model with raw head outputs: width,height pairs of every head separated by ';', the finest grid first");
+DEFINE_double(iou, YOLO_IOU_THRESHOLD, "Overlap above which NMS suppresses a YOLO box of the same class");
+DEFINE_string(trace, "", "Record per-frame pipeline events and write them as Chrome trace JSON to this path at exit");
+DEFINE_int32(trace_events, TRACE_DEFAULT_EVENTS, "Events kept per thread for -trace, older events are overwritten");
 
 int main(int argc, char* argv[]) {
+    auto process_start = std::chrono::steady_clock::now();
     gflags::ParseCommandLineFlags(&argc, &argv, true);
-    int frameNum = 0;
+    HevcDecodeMode decode_mode = HEVC_DECODE_ALL;
+    if (!ParseHevcDecodeMode(FLAGS_decode_mode, &decode_mode)) {
+        printf("Unknown -decode_mode %s\n", FLAGS_decode_mode.c_str());
+        return 1;
+    }
+    if (FLAGS_device != "GPU" && FLAGS_device != "CPU") {
+        printf("Unknown -device %s\n", FLAGS_device.c_str());
+        return 1;
+    }
+    // the CPU path decodes with the oneVPL CPU runtime into system memory and infers from host tensors
+    bool on_cpu = FLAGS_device == "CPU";
+
+    // frame counts come from the access unit index, nothing is decoded
+    if (FLAGS_count_frames) {
+        for (auto& input : split_string(FLAGS_i)) {
+            std::shared_ptr<FileMapping> mapping = MapFile(input.c_str());
+            std::shared_ptr<const HevcIndex> index;
+            if (mapping)
+                index = LoadHevcIndex(input.c_str(), *mapping);
+            if (!index) {
+                printf("Not able to index %s\n", input.c_str());
+                continue;
+            }
+            size_t decoded = 0;
+            for (mfxU32 i = 0; i < index->units.size(); i++)
+                decoded += index->IsDecoded(i, decode_mode);
+            printf("%s: %zu of %zu frames decoded with -decode_mode %s\n",
+                   input.c_str(),
+                   decoded,
+                   index->FrameCount(),
+                   FLAGS_decode_mode.c_str());
+        }
+        return 0;
+    }
 
     // setup OpenVINO Inference Engine
     ov::Core core;
 
-    // configuration for Multiple streams on GPU
-    std::string key = "GPU_THROUGHPUT_STREAMS";
+    // configuration for Multiple streams on the device
+    std::string key = FLAGS_device + "_THROUGHPUT_STREAMS";
     ov::AnyMap config;
     config[key] = FLAGS_ns;
-    core.set_property("GPU", config);
+    core.set_property(FLAGS_device, config);
+    if (!FLAGS_cache_dir.empty())
+        core.set_property(ov::cache_dir(FLAGS_cache_dir));
 
     // read network model
     std::shared_ptr<ov::Model> model = core.read_model(FLAGS_m);
@@ -57,97 +129,390 @@ int main(int argc, char* argv[]) {
     int num_source = inputs.size();
 
     // setup VPL
-    Decode_vpp decode_vpp(inputs, shape);
+    DecodeOptions decode_options;
+    decode_options.completeFrame = FLAGS_complete_frame;
+    decode_options.segments = FLAGS_segments;
+    decode_options.prefetchDepth = (size_t)FLAGS_prefetch_mb << 20;
+    decode_options.ioThreads = FLAGS_io_threads;
+    decode_options.initThreads = FLAGS_init_threads > 0 ? FLAGS_init_threads : 0;
+    decode_options.decodeThreads = FLAGS_decode_threads > 0 ? FLAGS_decode_threads : 0;
+    decode_options.decodeMode = decode_mode;
+    decode_options.systemMemory = on_cpu;
+    // a stream can have a full queue plus every request's batch out of the decoder at once
+    decode_options.queueSize = FLAGS_queue_size > 0 ? FLAGS_queue_size : 1;
+    decode_options.outputPool = decode_options.queueSize + FLAGS_nr * FLAGS_bs;
+    for (auto& weight : split_string(FLAGS_weights))
+        decode_options.weights.push_back(atof(weight.c_str()));
+    if (decode_options.weights.size() == 1)
+        decode_options.weights.resize(inputs.size(), decode_options.weights[0]);
+    for (auto& name : split_string(FLAGS_overflow)) {
+        OverflowPolicy policy;
+        if (!ParseOverflowPolicy(name, &policy)) {
+            printf("Unknown -overflow %s\n", name.c_str());
+            return 1;
+        }
+        decode_options.overflow.push_back(policy);
+    }
+    if (!ParsePlacementPolicy(FLAGS_placement, &decode_options.placement.policy)) {
+        printf("Unknown -placement %s\n", FLAGS_placement.c_str());
+        return 1;
+    }
+    if (decode_options.placement.enabled()) {
+        ThreadPlacement& placement = decode_options.placement;
+        placement.topology = CpuTopology::Read();
+        auto node = std::find(placement.topology.nodeIds.begin(), placement.topology.nodeIds.end(), FLAGS_infer_node);
+        if (node == placement.topology.nodeIds.end()) {
+            printf("No CPU of node %d available for -infer_node\n", FLAGS_infer_node);
+            return 1;
+        }
+        placement.inferNode = node - placement.topology.nodeIds.begin();
+        // the threads created from here on (I/O, postprocessing) inherit the inference node,
+        // the decode workers pin themselves to their own
+        PinCurrentThread(placement.infer_cpus());
+        printf("batching, infer completion and postprocess threads: node %d, cpus %s\n",
+               FLAGS_infer_node,
+               FormatCpuList(placement.infer_cpus()).c_str());
+    }
+    // hot added streams take the policy given for all inputs
+    OverflowPolicy attach_overflow = decode_options.overflow.size() == 1 ? decode_options.overflow[0] : OVERFLOW_BLOCK;
+    if (decode_options.overflow.size() == 1)
+        decode_options.overflow.resize(inputs.size(), decode_options.overflow[0]);
+    for (auto& fps : split_string(FLAGS_infer_fps))
+        decode_options.inferFps.push_back(atof(fps.c_str()));
+    if (decode_options.inferFps.size() == 1)
+        decode_options.inferFps.resize(inputs.size(), decode_options.inferFps[0]);
+    // raw YOLO heads are decoded relative to the network input
+    YoloConfig yolo_config;
+    if (!ParseYoloAnchors(FLAGS_yolo_anchors, &yolo_config.anchors)) {
+        printf("Malformed -yolo_anchors %s\n", FLAGS_yolo_anchors.c_str());
+        return 1;
+    }
+    yolo_config.inputWidth = shape[3];
+    yolo_config.inputHeight = shape[2];
+    yolo_config.iou = (float)FLAGS_iou;
+    Decode_vpp decode_vpp(inputs, shape, decode_options);
     auto lvaDisplay = decode_vpp.get_context();
-    auto input_shape = decode_vpp.get_input_shape();
 
     // integrate preprocessing steps into the execution graph with Preprocessing API
-    openvino_preprocess(model);
+    openvino_preprocess(model, !on_cpu);
 
     if (FLAGS_bs > 1)
         ov::set_batch(model, FLAGS_bs);
     // zero-copy conversion from VAAPI surface to OpenVINO toolkit tensors (one for Y plane, another for UV)
-    auto shared_va_context = ov::intel_gpu::ocl::VAContext(core, lvaDisplay);
-    ov::CompiledModel compiled_model = core.compile_model(model, shared_va_context);
+    std::unique_ptr<ov::intel_gpu::ocl::VAContext> shared_va_context;
+    std::unique_ptr<RemoteTensorCache> tensor_cache;
+    ov::CompiledModel compiled_model;
+    std::string blob_path;
+    if (!FLAGS_blob_dir.empty()) {
+        std::string blob_config = FLAGS_device + " bs=" + std::to_string(FLAGS_bs) + " ns=" + std::to_string(FLAGS_ns) +
+                                  " nv12 " + (on_cpu ? "host" : "surface");
+        blob_path = CompiledBlobPath(FLAGS_blob_dir, FLAGS_m, blob_config);
+    }
+    bool imported = false;
+    auto load_start = std::chrono::steady_clock::now();
+    if (on_cpu) {
+        compiled_model = CompileOrImport(
+            blob_path,
+            [&] { return core.compile_model(model, "CPU"); },
+            [&](std::istream& blob) { return core.import_model(blob, "CPU"); },
+            &imported);
+    } else {
+        shared_va_context.reset(new ov::intel_gpu::ocl::VAContext(core, lvaDisplay));
+        tensor_cache.reset(new RemoteTensorCache(*shared_va_context));
+        compiled_model = CompileOrImport(
+            blob_path,
+            [&] { return core.compile_model(model, *shared_va_context); },
+            [&](std::istream& blob) { return core.import_model(blob, *shared_va_context); },
+            &imported);
+    }
+    std::chrono::duration<double, std::milli> load_ms = std::chrono::steady_clock::now() - load_start;
+    printf("Model %s in %.1f ms\n", imported ? "imported" : "compiled", load_ms.count());
 
-    // create the queue for free infer request
-    BlockingQueue<ov::InferRequest> free_requests;
-    for (int i = 0; i < FLAGS_nr; i++)
-        free_requests.push(compiled_model.create_infer_request());
+    // create the infer requests, the queue holds the indexes of the free ones
+    std::vector<ov::InferRequest> requests;
+    BlockingQueue<size_t> free_requests;
+    for (int i = 0; i < FLAGS_nr; i++) {
+        requests.push_back(compiled_model.create_infer_request());
+        free_requests.push(i);
+    }
+
+    size_t output_count = compiled_model.outputs().size();
 
     auto t1 = std::chrono::high_resolution_clock::now();
 
+    // one trace track per request shows its inference from start_async to completion
+    std::vector<int> infer_tracks(FLAGS_nr);
+    if (!FLAGS_trace.empty()) {
+        Trace::Get().Start(FLAGS_trace, FLAGS_trace_events);
+        Trace::Get().name_thread("main");
+        for (int i = 0; i < FLAGS_nr; i++)
+            infer_tracks[i] = Trace::Get().add_track("infer request " + std::to_string(i));
+    }
+
+    if (!FLAGS_metrics.empty()) {
+        Metrics::Get().add_gauge("frame_queue_depth", [&] { return (double)decode_vpp.queue_depth(); });
+        Metrics::Get().add_gauge("dropped_frames", [&] { return (double)decode_vpp.dropped_frames(); });
+        Metrics::Get().add_gauge("infer_requests_in_flight", [&] { return (double)(FLAGS_nr - free_requests.size()); });
+        if (tensor_cache) {
+            Metrics::Get().add_gauge("remote_tensor_cache_hits", [&] { return (double)tensor_cache->hits(); });
+            Metrics::Get().add_gauge("remote_tensor_cache_misses", [&] { return (double)tensor_cache->misses(); });
+        }
+        Metrics::Get().Start(FLAGS_metrics, std::chrono::milliseconds(FLAGS_metrics_interval_ms));
+    }
+
+    // segments of one file finish out of order, their detections are printed in frame order;
+    // frames that never reach inference are skipped so they do not hold back the later ones
+    bool reorder = FLAGS_segments > 1;
+    FrameReorderBuffer reordered_results;
+    if (reorder)
+        decode_vpp.set_skip_callback([&](mfxU64 first, mfxU64 last) { reordered_results.skip(first, last); });
+
     // reading the input data and start decoding
-    decode_vpp.decoding(inputs);
-    BlockingQueue<std::pair<std::vector<std::pair<mfxFrameSurface1*, size_t>>, ov::InferRequest>> busy_requests;
-
-    // async thread waiting for inference completion and printing inference results
-    std::thread thread([&] {
-        for (;;) {
-            auto res = busy_requests.pop();
-            auto batched_frames = res.first;
-            auto infer_request = res.second;
-            if (!infer_request)
-                break;
-            infer_request.wait();
-            ov::Tensor output_tensor = infer_request.get_output_tensor(0);
-            PrintMultiResults(output_tensor, batched_frames, input_shape);
-            // When application completes the work with frame surface, it must call release to avoid memory leaks
-            for (auto frame : batched_frames)
-            {
-                frame.first->FrameInterface->Release(frame.first);
-            }
-            free_requests.push(infer_request);
+    decode_vpp.decoding();
+
+    // -hotplug events run on their own thread at their time after the start, the others streams keep going
+    struct HotplugEvent {
+        long long ms;
+        bool attach;
+        std::string target;  // path to attach or id to detach
+    };
+    std::vector<HotplugEvent> hotplug_events;
+    for (auto& event : split_string(FLAGS_hotplug)) {
+        size_t at = event.rfind('@');
+        if (event.size() < 2 || (event[0] != '+' && event[0] != '-') || at == std::string::npos) {
+            printf("Ignoring -hotplug event %s\n", event.c_str());
+            continue;
+        }
+        hotplug_events.push_back({atoll(event.c_str() + at + 1), event[0] == '+', event.substr(1, at - 1)});
+    }
+    std::sort(hotplug_events.begin(), hotplug_events.end(), [](const HotplugEvent& a, const HotplugEvent& b) {
+        return a.ms < b.ms;
+    });
+    std::mutex hotplug_mutex;
+    std::condition_variable hotplug_stop;
+    bool pipeline_done = false;
+    std::thread hotplug([&] {
+        auto start = std::chrono::steady_clock::now();
+        for (auto& event : hotplug_events) {
+            std::unique_lock<std::mutex> lock(hotplug_mutex);
+            if (hotplug_stop.wait_until(lock, start + std::chrono::milliseconds(event.ms), [&] { return pipeline_done; }))
+                return;
+            lock.unlock();
+            if (event.attach)
+                decode_vpp.attach(event.target, 0, 1.0, attach_overflow);
+            else if (!decode_vpp.detach((size_t)atoll(event.target.c_str())))
+                printf("No stream %s to detach\n", event.target.c_str());
         }
-        printf("print_tensor() thread completed\n"); });
+    });
+    int attached = (int)std::count_if(hotplug_events.begin(), hotplug_events.end(), [](const HotplugEvent& e) {
+        return e.attach;
+    });
+
+    int total_frames = FLAGS_fr * (num_source + attached);
+    if (reorder && decode_vpp.get_frame_count() > 0)
+        total_frames = (int)decode_vpp.get_frame_count();
+
+    // requests complete in any order: the completion callback keeps a copy of the output,
+    // hands the request back right away and leaves printing and surface release to the pool
+    std::vector<std::vector<DecodedFrame>> inflight_frames(FLAGS_nr);
+    std::vector<std::chrono::steady_clock::time_point> inflight_start(FLAGS_nr);
+    std::mutex print_mutex;
+    // from process start until the first inference completed
+    std::atomic<bool> first_frame_done(false);
+    std::chrono::duration<double, std::milli> first_frame_ms(0);
+    // decode to result of every frame, for -report_json
+    std::mutex latency_mutex;
+    std::vector<double> frame_latency_ms;
+    // detections of every batch, printed in frame order when reordering, as they complete otherwise
+    DetectionConsumer consume_detections = [&](const std::vector<DecodedFrame>& frames, const DetectionBatch& detections) {
+        if (reorder) {
+            std::vector<std::string> results = FormatDetections(detections, frames);
+            for (size_t b = 0; b < frames.size(); b++)
+                reordered_results.push(frames[b].frame_index, results[b]);
+        } else {
+            std::unique_lock<std::mutex> lock(print_mutex);
+            PrintMultiResults(frames, detections);
+        }
+    };
+    ThreadPool postprocess(FLAGS_pp_threads > 0 ? FLAGS_pp_threads : 1);
+    for (size_t id = 0; id < requests.size(); id++) {
+        requests[id].set_callback([&, id](std::exception_ptr error) {
+            std::vector<DecodedFrame> batched_frames = std::move(inflight_frames[id]);
+            auto completed = std::chrono::steady_clock::now();
+            // the completion thread belongs to OpenVINO, it joins the inference node on its first callback
+            static thread_local bool placed = false;
+            if (!placed && decode_options.placement.enabled())
+                PinCurrentThread(decode_options.placement.infer_cpus());
+            placed = true;
+            Metrics::Get().record(METRIC_INFER, completed - inflight_start[id]);
+            if (!first_frame_done.exchange(true))
+                first_frame_ms = completed - process_start;
+            Trace::Get().name_thread("infer completion");
+            Trace::Get().record(kMetricStageNames[METRIC_INFER],
+                                inflight_start[id],
+                                completed,
+                                batched_frames[0].frame_index,
+                                infer_tracks[id]);
+            // every output is copied, detectors with raw YOLO heads have one per grid
+            std::vector<ov::Tensor> outputs;
+            if (error) {
+                try {
+                    std::rethrow_exception(error);
+                } catch (const std::exception& e) {
+                    printf("Inference failed: %s\n", e.what());
+                }
+            } else {
+                for (size_t o = 0; o < output_count; o++) {
+                    ov::Tensor result = requests[id].get_output_tensor(o);
+                    outputs.push_back(ov::Tensor(result.get_element_type(), result.get_shape()));
+                    memcpy(outputs.back().data(), result.data(), result.get_byte_size());
+                }
+            }
+            // decoding and suppression of the detections run on the postprocess pool, not on the completion thread;
+            // the request goes back only after its task is queued, shutdown waits for both in that order
+            postprocess.submit([&, batched_frames, outputs] {
+                Trace::Get().name_thread("postprocess");
+                MetricScope scope(METRIC_POSTPROCESS, batched_frames[0].frame_index);
+                if (!outputs.empty()) {
+                    // parsed into arrays reused by every batch of this thread
+                    static thread_local DetectionBatch detections;
+                    if (ParseMultiResults(outputs, yolo_config, batched_frames, detections) || reorder) {
+                        consume_detections(batched_frames, detections);
+                    } else {
+                        std::unique_lock<std::mutex> lock(print_mutex);
+                        for (auto& output : outputs)
+                            std::cout << "  output shape=" << output.get_shape() << std::endl;
+                    }
+                } else if (reorder) {
+                    for (auto& frame : batched_frames)
+                        reordered_results.skip(frame.frame_index, frame.frame_index + 1);
+                }
+                // When application completes the work with frame surface, it must call release to avoid memory leaks
+                auto done = std::chrono::steady_clock::now();
+                for (auto frame : batched_frames)
+                {
+                    if (on_cpu)
+                        frame.surface->FrameInterface->Unmap(frame.surface);
+                    decode_vpp.release(frame);
+                    Metrics::Get().count_frame(frame.stream_id);
+                    Metrics::Get().record(METRIC_FRAME_AGE, done - frame.queued);
+                }
+                if (!FLAGS_report_json.empty()) {
+                    std::unique_lock<std::mutex> lock(latency_mutex);
+                    for (auto& frame : batched_frames)
+                        frame_latency_ms.push_back(std::chrono::duration<double, std::milli>(done - frame.queued).count());
+                }
+            });
+            free_requests.push(id);
+        });
+    }
 
     int inferedNum = 0;
     // frame loop
-    std::vector<std::pair<mfxFrameSurface1*, size_t>> batched_frames;
-
-    for (;;) {
-        inferedNum++;
-        if (inferedNum > FLAGS_fr * num_source)  // End-Of-Stream or error
-            break;
-        // video input, decode, resize
-        auto frame = decode_vpp.read();
-
-        // fill full batch
-        batched_frames.push_back(frame);
-        if (batched_frames.size() < FLAGS_bs)
-            continue;
+    std::vector<DecodedFrame> batched_frames;
+    FrameBatcher<Decode_vpp> batcher(decode_vpp, FLAGS_bs, std::chrono::microseconds((long long)(FLAGS_max_wait_ms * 1000)));
+
+    // the tensor cache is keyed by surface ID, attached and detached streams create and free surface pools
+    unsigned long long surface_generation = decode_vpp.surface_generation();
+
+    // a batch is full, timed out or the last one, partial batches are inferred as well
+    while (inferedNum < total_frames && batcher.next(batched_frames, total_frames - inferedNum)) {
+        inferedNum += batched_frames.size();
+        // lookups and invalidation both happen on this thread
+        if (tensor_cache && decode_vpp.surface_generation() != surface_generation) {
+            surface_generation = decode_vpp.surface_generation();
+            tensor_cache->invalidate();
+        }
 
         // zero-copy conversion from VASurfaceID to OpenVINO VASurfaceTensor (one tensor for Y plane, another for UV)
         std::vector<ov::Tensor> y_tensors;
         std::vector<ov::Tensor> uv_tensors;
-        for (auto va_surface : batched_frames) {
-            mfxResourceType lresourceType;
-            mfxHDL lresource;
-            va_surface.first->FrameInterface->GetNativeHandle(va_surface.first,
-                                                              &lresource,
-                                                              &lresourceType);
-            VASurfaceID lvaSurfaceID = *(VASurfaceID*)(lresource);
-            auto nv12_tensor = shared_va_context.create_tensor_nv12(shape[2], shape[3], lvaSurfaceID);
-            y_tensors.push_back(nv12_tensor.first);
-            uv_tensors.push_back(nv12_tensor.second);
+        {
+            MetricScope tensorScope(METRIC_TENSOR);
+            for (auto va_surface : batched_frames) {
+                if (on_cpu) {
+                    // the mapped planes are the tensors, the surface is unmapped once its request completed
+                    auto nv12_tensor = WrapNV12HostTensors(va_surface.surface, shape[2], shape[3]);
+                    y_tensors.push_back(nv12_tensor.first);
+                    uv_tensors.push_back(nv12_tensor.second);
+                    continue;
+                }
+                mfxResourceType lresourceType;
+                mfxHDL lresource;
+                va_surface.surface->FrameInterface->GetNativeHandle(va_surface.surface,
+                                                                  &lresource,
+                                                                  &lresourceType);
+                VASurfaceID lvaSurfaceID = *(VASurfaceID*)(lresource);
+                auto nv12_tensor = tensor_cache->get(lvaSurfaceID, shape[2], shape[3]);
+                y_tensors.push_back(nv12_tensor.first);
+                uv_tensors.push_back(nv12_tensor.second);
+            }
+        }
+        // the model is compiled for FLAGS_bs images, a partial batch repeats its last frame
+        // and the detections of the padding slots are ignored
+        while (y_tensors.size() < (size_t)FLAGS_bs) {
+            y_tensors.push_back(y_tensors.back());
+            uv_tensors.push_back(uv_tensors.back());
         }
 
         // get inference request and start asynchronously
-        ov::InferRequest infer_request = free_requests.pop();
-        infer_request.set_input_tensors(0, y_tensors);   // first input is batch of Y planes
-        infer_request.set_input_tensors(1, uv_tensors);  // second input is batch of UV planes
-        infer_request.start_async();
-        busy_requests.push({batched_frames, infer_request});
+        TraceScope submitScope("submit", batched_frames[0].frame_index);
+        size_t id = free_requests.pop();
+        inflight_frames[id] = batched_frames;
+        requests[id].set_input_tensors(0, y_tensors);   // first input is batch of Y planes
+        requests[id].set_input_tensors(1, uv_tensors);  // second input is batch of UV planes
+        inflight_start[id] = std::chrono::steady_clock::now();
+        requests[id].start_async();
+    }
 
-        batched_frames.clear();
+    {
+        std::unique_lock<std::mutex> lock(hotplug_mutex);
+        pipeline_done = true;
     }
+    hotplug_stop.notify_all();
+    hotplug.join();
 
-    // wait for all inference requests in queue
-    busy_requests.push({});
-    thread.join();
-    printf("decoded and infered %d frames\n", inferedNum - 1);
+    // every request is back once all inferences completed, then the pool finishes the queued results
+    for (int i = 0; i < FLAGS_nr; i++)
+        free_requests.pop();
+    postprocess.wait_idle();
+    reordered_results.flush();
+    batcher.print_summary();
+    decode_vpp.print_schedule_summary();
+    printf("dropped %llu frames\n", decode_vpp.dropped_frames());
+    if (tensor_cache)
+        tensor_cache->print_summary();
+    printf("decoded and infered %d frames\n", inferedNum);
     auto t2 = std::chrono::high_resolution_clock::now();
     std::chrono::duration<double, std::milli> fp_ms = t2 - t1;
     std::cout << "Time = " << fp_ms.count() << "ms" << std::endl;
+    printf("Time to first frame: %.1f ms (model %s in %.1f ms)\n",
+           first_frame_ms.count(),
+           imported ? "imported" : "compiled",
+           load_ms.count());
+    Metrics::Get().Stop();
+
+    if (!FLAGS_report_json.empty()) {
+        FILE* report = fopen(FLAGS_report_json.c_str(), "w");
+        if (!report) {
+            printf("Not able to write %s\n", FLAGS_report_json.c_str());
+            return 1;
+        }
+        fprintf(report,
+                "{\"device\": \"%s\", \"frames\": %d, \"fps\": %.3f, "
+                "\"latency_ms\": {\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f}, \"peak_rss_mb\": %.1f, "
+                "\"time_to_first_frame_ms\": %.3f, \"model_load_ms\": %.3f, \"model_imported\": %s}\n",
+                FLAGS_device.c_str(),
+                inferedNum,
+                inferedNum / (fp_ms.count() / 1000),
+                Percentile(frame_latency_ms, 50),
+                Percentile(frame_latency_ms, 90),
+                Percentile(frame_latency_ms, 99),
+                PeakRssMb(),
+                first_frame_ms.count(),
+                load_ms.count(),
+                imported ? "true" : "false");
+        fclose(report);
+    }
     return 0;
 }
@@ -0,0 +1,275 @@
+/*******************************************************************************
+ * Copyright (C) 2022 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ ******************************************************************************/
+
+#pragma once
+
+#include <stdlib.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <new>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#define MPMC_CACHE_LINE 64
+#define MPMC_SPIN_COUNT 128
+#define MPMC_YIELD_COUNT 16
+
+namespace multi_source {
+// Bounded lock-free multi-producer/multi-consumer ring buffer (D. Vyukov's design).
+// push() blocks while the queue is full and pop() while it is empty, the same as
+// BlockingQueue::push(value, queue_limit) with queue_limit = capacity.
+// Waiting spins first, then yields, then parks on a condition variable.
+template <typename T>
+class MpmcQueue {
+   public:
+    // capacity is rounded up to a power of two
+    explicit MpmcQueue(size_t capacity) {
+        _capacity = 1;
+        while (_capacity < capacity)
+            _capacity <<= 1;
+        _mask = _capacity - 1;
+
+        void* cells = nullptr;
+        if (posix_memalign(&cells, MPMC_CACHE_LINE, sizeof(Cell) * _capacity) != 0)
+            throw std::bad_alloc();
+        _cells = static_cast<Cell*>(cells);
+        for (size_t i = 0; i < _capacity; i++) {
+            new (&_cells[i]) Cell();
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~MpmcQueue() {
+        for (size_t i = 0; i < _capacity; i++)
+            _cells[i].~Cell();
+        free(_cells);
+    }
+
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    bool try_push(T const& value) {
+        return try_push_n(&value, 1) == 1;
+    }
+
+    bool try_pop(T& value) {
+        return try_pop_n(&value, 1) == 1;
+    }
+
+    // Claim up to n consecutive free cells with a single CAS, returns how many were pushed
+    size_t try_push_n(T const* values, size_t n) {
+        size_t pos = _enqueuePos.value.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t count = 0;
+            while (count < n) {
+                size_t seq = _cells[(pos + count) & _mask].sequence.load(std::memory_order_acquire);
+                if (seq != pos + count)
+                    break;
+                count++;
+            }
+            if (count == 0) {
+                size_t seq = _cells[pos & _mask].sequence.load(std::memory_order_acquire);
+                if ((intptr_t)seq - (intptr_t)pos < 0)
+                    return 0;  // full
+                pos = _enqueuePos.value.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (_enqueuePos.value.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                for (size_t i = 0; i < count; i++) {
+                    Cell& cell = _cells[(pos + i) & _mask];
+                    cell.value = values[i];
+                    cell.sequence.store(pos + i + 1, std::memory_order_release);
+                }
+                wake(_popWaiters, _popMutex, _popCondition, count);
+                return count;
+            }
+        }
+    }
+
+    // Claim up to n consecutive filled cells with a single CAS, returns how many were popped
+    size_t try_pop_n(T* values, size_t n) {
+        size_t pos = _dequeuePos.value.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t count = 0;
+            while (count < n) {
+                size_t seq = _cells[(pos + count) & _mask].sequence.load(std::memory_order_acquire);
+                if (seq != pos + count + 1)
+                    break;
+                count++;
+            }
+            if (count == 0) {
+                size_t seq = _cells[pos & _mask].sequence.load(std::memory_order_acquire);
+                if ((intptr_t)seq - (intptr_t)(pos + 1) < 0)
+                    return 0;  // empty
+                pos = _dequeuePos.value.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (_dequeuePos.value.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+                for (size_t i = 0; i < count; i++) {
+                    Cell& cell = _cells[(pos + i) & _mask];
+                    values[i] = std::move(cell.value);
+                    cell.sequence.store(pos + i + _capacity, std::memory_order_release);
+                }
+                wake(_pushWaiters, _pushMutex, _pushCondition, count);
+                return count;
+            }
+        }
+    }
+
+    void push(T const& value) {
+        push_n(&value, 1);
+    }
+
+    T pop() {
+        T value;
+        pop_n(&value, 1);
+        return value;
+    }
+
+    // push all n values, blocking whenever the queue is full
+    void push_n(T const* values, size_t n) {
+        size_t done = 0;
+        while (done < n) {
+            wait(_pushWaiters, _pushMutex, _pushCondition,
+                 [&] {
+                     size_t pushed = try_push_n(values + done, n - done);
+                     done += pushed;
+                     return pushed > 0;
+                 },
+                 [this] { return can_push(); });
+        }
+    }
+
+    // wait for at least one value and pop up to n, returns how many were popped
+    size_t pop_n(T* values, size_t n) {
+        size_t popped = 0;
+        wait(_popWaiters, _popMutex, _popCondition,
+             [&] { return (popped = try_pop_n(values, n)) > 0; },
+             [this] { return can_pop(); });
+        return popped;
+    }
+
+    // pop one value, waiting no longer than deadline; returns false if the queue stayed empty
+    bool pop_until(T& value, std::chrono::steady_clock::time_point deadline) {
+        return wait(_popWaiters, _popMutex, _popCondition,
+                    [&] { return try_pop(value); },
+                    [this] { return can_pop(); },
+                    deadline);
+    }
+
+    // approximate while producers or consumers are running
+    size_t size() const {
+        size_t tail = _enqueuePos.value.load(std::memory_order_acquire);
+        size_t head = _dequeuePos.value.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    size_t capacity() const {
+        return _capacity;
+    }
+
+   private:
+    struct alignas(MPMC_CACHE_LINE) Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    // keeps the producer and consumer positions on separate cache lines
+    struct alignas(MPMC_CACHE_LINE) Position {
+        std::atomic<size_t> value{0};
+    };
+
+    bool can_push() const {
+        size_t pos = _enqueuePos.value.load(std::memory_order_relaxed);
+        return _cells[pos & _mask].sequence.load(std::memory_order_acquire) == pos;
+    }
+
+    bool can_pop() const {
+        size_t pos = _dequeuePos.value.load(std::memory_order_relaxed);
+        return _cells[pos & _mask].sequence.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    // attempt() does the operation, ready() only checks whether it may succeed and is
+    // evaluated under the park mutex, so no operation ever runs with a mutex held.
+    // Returns false once deadline has passed without attempt() succeeding.
+    template <typename Attempt, typename Ready>
+    bool wait(std::atomic<int>& waiters,
+              std::mutex& mutex,
+              std::condition_variable& condition,
+              Attempt attempt,
+              Ready ready,
+              std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max()) {
+        bool timed = deadline != std::chrono::steady_clock::time_point::max();
+        // spinning only pays off when the other side can run at the same time
+        static const int spins = std::thread::hardware_concurrency() > 1 ? MPMC_SPIN_COUNT : 0;
+        for (int i = 0; i < spins; i++) {
+            if (attempt())
+                return true;
+            cpu_relax();
+        }
+        for (int i = 0; i < MPMC_YIELD_COUNT; i++) {
+            if (attempt())
+                return true;
+            std::this_thread::yield();
+        }
+        while (!attempt()) {
+            // the waiter is announced before ready() is checked, wake() reads the counter after publishing
+            std::unique_lock<std::mutex> lock(mutex);
+            waiters.fetch_add(1, std::memory_order_seq_cst);
+            bool woken = true;
+            if (timed)
+                woken = condition.wait_until(lock, deadline, ready);
+            else
+                condition.wait(lock, ready);
+            waiters.fetch_sub(1, std::memory_order_relaxed);
+            if (!woken) {
+                lock.unlock();
+                return attempt();
+            }
+        }
+        return true;
+    }
+
+    // one parked thread per published cell, waking all of them only makes them fight over it
+    void wake(std::atomic<int>& waiters, std::mutex& mutex, std::condition_variable& condition, size_t count) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int parked = waiters.load(std::memory_order_relaxed);
+        if (parked > 0) {
+            std::unique_lock<std::mutex> lock(mutex);
+            if (count >= (size_t)parked) {
+                condition.notify_all();
+            } else {
+                for (size_t i = 0; i < count; i++)
+                    condition.notify_one();
+            }
+        }
+    }
+
+    static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    Cell* _cells;
+    size_t _capacity;
+    size_t _mask;
+    Position _enqueuePos;
+    Position _dequeuePos;
+    std::atomic<int> _pushWaiters{0};
+    std::atomic<int> _popWaiters{0};
+    std::mutex _pushMutex;
+    std::mutex _popMutex;
+    std::condition_variable _pushCondition;
+    std::condition_variable _popCondition;
+};
+}  // namespace multi_source
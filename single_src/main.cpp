@@ -14,7 +14,12 @@
 #include <gflags/gflags.h>
 #include <gpu/gpu_context_api_va.hpp>
 #include <openvino/openvino.hpp>
+#include "utils/hevc_index.h"
 #include "utils/functions.h"
+#include "utils/metrics.h"
+#include "utils/model_cache.h"
+#include "utils/remote_tensor_cache.h"
+#include "utils/trace.h"
 #include "utils/util.h"
 
 #define BITSTREAM_BUFFER_SIZE 2000000
@@ -25,14 +30,26 @@
 
 DEFINE_string(i, "", "Required. Path to one input video files ");
 DEFINE_string(m, "", "Required. Path to IR .xml file");
-
-mfxSession CreateVPLSession(mfxLoader* loader);
+DEFINE_string(device, "GPU", "Device for decode and inference, 'CPU' or 'GPU'");
+DEFINE_bool(complete_frame, false, "Index the input and submit whole frames to the decoder");
+DEFINE_string(decode_mode, "all", "Pictures to decode: 'all', 'ref' (skip non-reference pictures) or 'key' (IDR/CRA/BLA only)");
+DEFINE_int32(depth, 0, "Number of inferences kept in flight while the next frames decode, 0 infers every frame serially");
+DEFINE_string(cache_dir, "", "Directory of the OpenVINO compiled model cache (ov::cache_dir), empty disables it");
+DEFINE_string(blob_dir, "", "Directory to export the compiled model to and import it from on the next run, keyed by model, device and preprocessing");
+DEFINE_string(metrics, "", "Export per-stage latency histograms and FPS: '-' prints JSON lines, otherwise path of a Prometheus text file");
+DEFINE_int32(metrics_interval_ms, 1000, "Interval of the -metrics export");
+DEFINE_string(trace, "", "Record per-frame pipeline events and write them as Chrome trace JSON to this path at exit");
+DEFINE_int32(trace_events, TRACE_DEFAULT_EVENTS, "Events kept per thread for -trace, older events are overwritten");
+DEFINE_bool(compare, false, "Run the input serially and then pipelined with -depth, printing the FPS of both");
+
+mfxSession CreateVPLSession(mfxLoader* loader, bool software);
 void PrintTopResults(const float* output, mfxU16 width, mfxU16 height, ov::Shape output_shape);
 
 int main(int argc, char** argv) {
+    auto process_start = std::chrono::steady_clock::now();
     gflags::ParseCommandLineFlags(&argc, &argv, true);
 
-    FILE* source = NULL;
+    std::unique_ptr<BitstreamSource> source;
     mfxLoader loader = NULL;
     mfxSession session = NULL;
     mfxFrameSurface1* decSurfaceOut = NULL;
@@ -47,15 +64,13 @@ int main(int argc, char** argv) {
     bool isDrainingDec = false;
     bool isDrainingVPP = false;
     mfxStatus sts = MFX_ERR_NONE;
-    Params cliParams = {};
 
     ov::Core core;
     std::shared_ptr<ov::Model> model;
     ov::CompiledModel compiled_model;
-    ov::InferRequest infer_request;
     ov::Shape output_shape;
 
-    VADisplay lvaDisplay;
+    VADisplay lvaDisplay = NULL;
     VASurfaceID lvaSurfaceID;
     mfxHandleType ldeviceType;
     mfxHDL lresource;
@@ -68,10 +83,34 @@ int main(int argc, char** argv) {
     mfxU16 vppInImgWidth, vppInImgHeight;
     mfxU16 vppOutImgWidth, vppOutImgHeight;
 
-    source = fopen(FLAGS_i.data(), "rb");
+    HevcDecodeMode decodeMode = HEVC_DECODE_ALL;
+    if (!ParseHevcDecodeMode(FLAGS_decode_mode, &decodeMode)) {
+        printf("Unknown -decode_mode %s\n", FLAGS_decode_mode.c_str());
+        return 1;
+    }
+    if (FLAGS_device != "GPU" && FLAGS_device != "CPU") {
+        printf("Unknown -device %s\n", FLAGS_device.c_str());
+        return 1;
+    }
+    // the CPU path decodes with the oneVPL CPU runtime into system memory and infers from the mapped planes
+    bool on_cpu = FLAGS_device == "CPU";
+    int depth = FLAGS_depth > 0 ? FLAGS_depth : 0;
+    if (FLAGS_compare && depth == 0)
+        depth = 4;
+
+    // skipping pictures needs the access unit index
+    std::shared_ptr<const HevcIndex> index;
+    auto open_source = [&] {
+        return (FLAGS_complete_frame || decodeMode != HEVC_DECODE_ALL)
+                   ? OpenIndexedBitstreamSource(FLAGS_i.data(), BITSTREAM_BUFFER_SIZE, &index, decodeMode)
+                   : OpenBitstreamSource(FLAGS_i.data(), BITSTREAM_BUFFER_SIZE);
+    };
+    source = open_source();
     VERIFY(source, "Could not open input file");
 
     //--- Setup OpenVINO Inference Engine
+    if (!FLAGS_cache_dir.empty())
+        core.set_property(ov::cache_dir(FLAGS_cache_dir));
     // Read network model
     model = core.read_model(FLAGS_m);
 
@@ -88,22 +127,19 @@ int main(int argc, char** argv) {
 
     //---- Setup VPL
     // Create VPL session
-    session = CreateVPLSession(&loader);
+    session = CreateVPLSession(&loader, on_cpu);
     VERIFY(session != NULL, "Not able to create VPL session");
 
     //-- Initialize Decode
     // Prepare input bitstream
-    bitstream.MaxLength = BITSTREAM_BUFFER_SIZE;
-    bitstream.Data = (mfxU8*)calloc(bitstream.MaxLength, sizeof(mfxU8));
-    VERIFY(bitstream.Data, "Not able to allocate input buffer");
     bitstream.CodecId = MFX_CODEC_HEVC;
 
-    sts = ReadEncodedStream(bitstream, source);
+    sts = source->Feed(bitstream);
     VERIFY(MFX_ERR_NONE == sts, "Error reading bitstream");
 
     // Retrieve the frame information from input stream
     mfxDecParams.mfx.CodecId = MFX_CODEC_HEVC;
-    mfxDecParams.IOPattern = MFX_IOPATTERN_OUT_VIDEO_MEMORY;
+    mfxDecParams.IOPattern = on_cpu ? MFX_IOPATTERN_OUT_SYSTEM_MEMORY : MFX_IOPATTERN_OUT_VIDEO_MEMORY;
     sts = MFXVideoDECODE_DecodeHeader(session, &bitstream, &mfxDecParams);
     VERIFY(MFX_ERR_NONE == sts, "Error decoding header");
 
@@ -144,102 +180,281 @@ int main(int argc, char** argv) {
     mfxVPPParams.vpp.Out.FrameRateExtN = 30;
     mfxVPPParams.vpp.Out.FrameRateExtD = 1;
 
-    mfxVPPParams.IOPattern = MFX_IOPATTERN_IN_VIDEO_MEMORY | MFX_IOPATTERN_OUT_VIDEO_MEMORY;
+    mfxVPPParams.IOPattern = on_cpu ? MFX_IOPATTERN_IN_SYSTEM_MEMORY | MFX_IOPATTERN_OUT_SYSTEM_MEMORY
+                                    : MFX_IOPATTERN_IN_VIDEO_MEMORY | MFX_IOPATTERN_OUT_VIDEO_MEMORY;
 
-    // Initialize the VPP
-    sts = MFXVideoVPP_Init(session, &mfxVPPParams);
+    // Initialize the VPP, its output pool holds the frame being scaled and one per inference in flight
+    mfxU32 output_pool = (mfxU32)depth + 1;
+    sts = InitVPPWithOutputPool(session, &mfxVPPParams, output_pool);
     VERIFY(MFX_ERR_NONE == sts, "Error initializing VPP");
 
     // Get the vaapi device handle
-    sts = MFXVideoCORE_GetHandle(session, MFX_HANDLE_VA_DISPLAY, &lvaDisplay);
-    VERIFY(MFX_ERR_NONE == sts, "MFXVideoCore_GetHandle error");
+    if (!on_cpu) {
+        sts = MFXVideoCORE_GetHandle(session, MFX_HANDLE_VA_DISPLAY, &lvaDisplay);
+        VERIFY(MFX_ERR_NONE == sts, "MFXVideoCore_GetHandle error");
+    }
 
     // Integrate preprocessing steps into the execution graph with Preprocessing API
-    openvino_preprocess(model);
-    auto shared_va_context = ov::intel_gpu::ocl::VAContext(core, lvaDisplay);
-    compiled_model = core.compile_model(model, shared_va_context);
-
-    // Create infer request
-    infer_request = compiled_model.create_infer_request();
-    auto t1 = std::chrono::high_resolution_clock::now();
-    printf("Decoding VPP, and infering %s with %s\n", cliParams.infileName, cliParams.inmodelName);
-    while (isStillGoing == true) {
-        if (isDrainingDec == false) {
-            sts = ReadEncodedStream(bitstream, source);
-            if (sts != MFX_ERR_NONE)
-                isDrainingDec = true;
+    openvino_preprocess(model, !on_cpu);
+    std::unique_ptr<ov::intel_gpu::ocl::VAContext> shared_va_context;
+    std::unique_ptr<RemoteTensorCache> tensor_cache;
+    std::string blob_path;
+    if (!FLAGS_blob_dir.empty())
+        blob_path = CompiledBlobPath(FLAGS_blob_dir, FLAGS_m, FLAGS_device + " bs=1 nv12 " + (on_cpu ? "host" : "surface"));
+    bool imported = false;
+    auto load_start = std::chrono::steady_clock::now();
+    if (on_cpu) {
+        compiled_model = CompileOrImport(
+            blob_path,
+            [&] { return core.compile_model(model, "CPU"); },
+            [&](std::istream& blob) { return core.import_model(blob, "CPU"); },
+            &imported);
+    } else {
+        shared_va_context.reset(new ov::intel_gpu::ocl::VAContext(core, lvaDisplay));
+        tensor_cache.reset(new RemoteTensorCache(*shared_va_context));
+        compiled_model = CompileOrImport(
+            blob_path,
+            [&] { return core.compile_model(model, *shared_va_context); },
+            [&](std::istream& blob) { return core.import_model(blob, *shared_va_context); },
+            &imported);
+    }
+    std::chrono::duration<double, std::milli> load_ms = std::chrono::steady_clock::now() - load_start;
+    printf("Model %s in %.1f ms\n", imported ? "imported" : "compiled", load_ms.count());
+
+    // In-flight inferences, reused round robin: slot i holds the request of every depth-th frame
+    struct InferSlot {
+        ov::InferRequest request;
+        mfxFrameSurface1* surface;  // VPP output read by the request, released once it completed
+        std::chrono::steady_clock::time_point started;
+        int frame;  // position in decode order
+        int track;  // trace track of the slot
+    };
+    std::atomic<int> inflight(0);
+    std::vector<InferSlot> slots;
+
+    // Indexed sources stamp every picture with its position in the file
+    auto print_frame = [&](mfxFrameSurface1* surface) {
+        if (source->HasFrameIndex())
+            printf("Frame %llu\n", (unsigned long long)surface->Data.TimeStamp);
+    };
+
+    // Count an inferred frame, the first one gives the time to first frame
+    std::chrono::duration<double, std::milli> first_frame_ms(0);
+    auto frame_done = [&] {
+        if (first_frame_ms.count() == 0)
+            first_frame_ms = std::chrono::steady_clock::now() - process_start;
+        Metrics::Get().count_frame(0);
+    };
+
+    // Finish the inference of a slot, results are printed in frame order
+    auto complete = [&](InferSlot& slot) {
+        slot.request.wait();
+        auto completed = std::chrono::steady_clock::now();
+        Metrics::Get().record(METRIC_INFER, completed - slot.started);
+        Trace::Get().record(kMetricStageNames[METRIC_INFER], slot.started, completed, slot.frame, slot.track);
+        MetricScope scope(METRIC_POSTPROCESS, slot.frame);
+        print_frame(slot.surface);
+        PrintSingleResults(slot.request.get_output_tensor(0), oriImgWidth, oriImgHeight);
+        if (on_cpu)
+            slot.surface->FrameInterface->Unmap(slot.surface);
+        sts = slot.surface->FrameInterface->Release(slot.surface);
+        VERIFY(MFX_ERR_NONE == sts, "ERROR - mfxFrameSurfaceInterface->Release failed");
+        slot.surface = NULL;
+        inflight--;
+        frame_done();
+    };
+
+    // Decode, scale and infer the whole input, depth 0 waits for every inference before decoding on.
+    // With depth > 0 frame N+1 decodes and scales while up to depth earlier frames are inferred.
+    auto run = [&](int depth) {
+        frameNum = 0;
+        isStillGoing = true;
+        isDrainingDec = false;
+        isDrainingVPP = false;
+        while (slots.size() < (size_t)std::max(depth, 1)) {
+            int track = Trace::Get().add_track("infer slot " + std::to_string(slots.size()));
+            slots.push_back({compiled_model.create_infer_request(), NULL, std::chrono::steady_clock::time_point(), 0, track});
         }
 
-        if (!isDrainingVPP) {
-            // Run decode with onevpl
-            sts = onevpl_decode(session,
-                                (isDrainingDec) ? NULL : &bitstream,
-                                NULL,
-                                &pmfxDecOutSurface,
-                                &syncp);
-        } else {
-            sts = MFX_ERR_NONE;
+        auto t1 = std::chrono::high_resolution_clock::now();
+        while (isStillGoing == true) {
+            if (isDrainingDec == false) {
+                MetricScope scope(METRIC_READ);
+                sts = source->Feed(bitstream);
+                if (sts != MFX_ERR_NONE)
+                    isDrainingDec = true;
+            }
+
+            if (!isDrainingVPP) {
+                // Run decode with onevpl
+                MetricScope scope(METRIC_DECODE);
+                sts = onevpl_decode(session,
+                                    (isDrainingDec) ? NULL : &bitstream,
+                                    NULL,
+                                    &pmfxDecOutSurface,
+                                    &syncp);
+            } else {
+                sts = MFX_ERR_NONE;
+            }
+
+            switch (sts) {
+                case MFX_ERR_NONE:
+                    // Run vpp with onevpl
+                    {
+                        MetricScope scope(METRIC_VPP);
+                        sts = onevpl_vpp(session, pmfxDecOutSurface, &pmfxVPPSurfacesOut);
+                    }
+                    // VPP keeps its own reference to the decoded surface
+                    if (pmfxDecOutSurface) {
+                        pmfxDecOutSurface->FrameInterface->Release(pmfxDecOutSurface);
+                        pmfxDecOutSurface = NULL;
+                    }
+                    if (sts == MFX_ERR_NONE) {
+                        {
+                            MetricScope scope(METRIC_SYNC, frameNum);
+                            sts = pmfxVPPSurfacesOut->FrameInterface->Synchronize(pmfxVPPSurfacesOut,
+                                                                                  SYNC_TIMEOUT);
+                        }
+                        VERIFY(MFX_ERR_NONE == sts, "MFXVideoCORE_SyncOperation error");
+
+                        // Wrap VPP output into remoteblobs, or the mapped planes into host tensors on CPU
+                        auto tensorStart = std::chrono::steady_clock::now();
+                        std::pair<ov::Tensor, ov::Tensor> nv12_blob;
+                        if (on_cpu) {
+                            nv12_blob = WrapNV12HostTensors(pmfxVPPSurfacesOut, height, width);
+                        } else {
+                            sts = pmfxVPPSurfacesOut->FrameInterface->GetNativeHandle(pmfxVPPSurfacesOut,
+                                                                                      &lresource,
+                                                                                      &lresourceType);
+                            VERIFY(MFX_ERR_NONE == sts, "FrameInterface->GetNativeHandle error");
+                            VERIFY(MFX_RESOURCE_VA_SURFACE == lresourceType,
+                                   "Display device is not MFX_HANDLE_VA_DISPLAY");
+
+                            lvaSurfaceID = *(VASurfaceID*)lresource;
+                            nv12_blob = tensor_cache->get(lvaSurfaceID, height, width);
+                        }
+                        auto tensorEnd = std::chrono::steady_clock::now();
+                        Metrics::Get().record(METRIC_TENSOR, tensorEnd - tensorStart);
+                        Trace::Get().record(kMetricStageNames[METRIC_TENSOR], tensorStart, tensorEnd, frameNum);
+
+                        if (depth == 0) {
+                            // Run inference with openvino
+                            inflight++;
+                            auto inferStart = std::chrono::steady_clock::now();
+                            ov::Tensor result = openvino_infer(nv12_blob, model, slots[0].request);
+                            auto inferEnd = std::chrono::steady_clock::now();
+                            Metrics::Get().record(METRIC_INFER, inferEnd - inferStart);
+                            Trace::Get().record(kMetricStageNames[METRIC_INFER], inferStart, inferEnd, frameNum, slots[0].track);
+                            inflight--;
+                            MetricScope scope(METRIC_POSTPROCESS, frameNum);
+                            frameNum++;
+                            print_frame(pmfxVPPSurfacesOut);
+                            // Release surface
+                            if (on_cpu)
+                                pmfxVPPSurfacesOut->FrameInterface->Unmap(pmfxVPPSurfacesOut);
+                            sts = pmfxVPPSurfacesOut->FrameInterface->Release(pmfxVPPSurfacesOut);
+                            VERIFY(MFX_ERR_NONE == sts, "ERROR - mfxFrameSurfaceInterface->Release failed");
+
+                            PrintSingleResults(result, oriImgWidth, oriImgHeight);
+                            frame_done();
+                        } else {
+                            // the slot is free once the inference started depth frames ago completed
+                            InferSlot& slot = slots[frameNum % depth];
+                            if (slot.surface)
+                                complete(slot);
+                            slot.surface = pmfxVPPSurfacesOut;
+                            slot.request.set_tensor(model->get_parameters().at(0)->get_friendly_name(),
+                                                    nv12_blob.first);
+                            slot.request.set_tensor(model->get_parameters().at(1)->get_friendly_name(),
+                                                    nv12_blob.second);
+                            slot.started = std::chrono::steady_clock::now();
+                            slot.frame = frameNum;
+                            inflight++;
+                            slot.request.start_async();
+                            frameNum++;
+                        }
+                    } else if (sts == MFX_ERR_MORE_DATA) {
+                        if (isDrainingVPP == true)
+                            isStillGoing = false;
+                    } else {
+                        if (sts < 0)
+                            isStillGoing = false;
+                    }
+                    break;
+                case MFX_ERR_MORE_DATA:
+                    // The function requires more bitstream at input before decoding can proceed
+                    if (isDrainingDec)
+                        isDrainingVPP = true;
+                    break;
+                default:
+                    isStillGoing = false;
+                    break;
+            }
         }
 
-        switch (sts) {
-            case MFX_ERR_NONE:
-                // Run vpp with onevpl
-                sts =
-                    onevpl_vpp(session, pmfxDecOutSurface, &pmfxVPPSurfacesOut);
-                if (sts == MFX_ERR_NONE) {
-                    sts = pmfxVPPSurfacesOut->FrameInterface->Synchronize(pmfxVPPSurfacesOut,
-                                                                          SYNC_TIMEOUT);
-                    VERIFY(MFX_ERR_NONE == sts, "MFXVideoCORE_SyncOperation error");
-
-                    sts = pmfxVPPSurfacesOut->FrameInterface->GetNativeHandle(pmfxVPPSurfacesOut,
-                                                                              &lresource,
-                                                                              &lresourceType);
-                    VERIFY(MFX_ERR_NONE == sts, "FrameInterface->GetNativeHandle error");
-                    VERIFY(MFX_RESOURCE_VA_SURFACE == lresourceType,
-                           "Display device is not MFX_HANDLE_VA_DISPLAY");
-
-                    lvaSurfaceID = *(VASurfaceID*)lresource;
-
-                    // Wrap VPP output into remoteblobs
-                    auto nv12_blob = shared_va_context.create_tensor_nv12(height, width, lvaSurfaceID);
-
-                    // Run inference with openvino
-                    ov::Tensor result = openvino_infer(nv12_blob, model, infer_request);
-                    frameNum++;
-                    // Release surface
-                    sts = pmfxVPPSurfacesOut->FrameInterface->Release(pmfxVPPSurfacesOut);
-                    VERIFY(MFX_ERR_NONE == sts, "ERROR - mfxFrameSurfaceInterface->Release failed");
-
-                    PrintSingleResults(result, oriImgWidth, oriImgHeight);
-                } else if (sts == MFX_ERR_MORE_DATA) {
-                    if (isDrainingVPP == true)
-                        isStillGoing = false;
-                } else {
-                    if (sts < 0)
-                        isStillGoing = false;
-                }
-                break;
-            case MFX_ERR_MORE_DATA:
-                // The function requires more bitstream at input before decoding can proceed
-                if (isDrainingDec)
-                    isDrainingVPP = true;
-                break;
-            default:
-                isStillGoing = false;
-                break;
+        // the oldest inference sits in the slot of the next frame
+        for (int i = 0; i < depth; i++) {
+            InferSlot& slot = slots[(frameNum + i) % depth];
+            if (slot.surface)
+                complete(slot);
         }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double, std::milli> fp_ms = t2 - t1;
+        std::cout << "Time = " << fp_ms.count() << "ms" << std::endl;
+        printf("Decoded %d frames\n", frameNum);
+        return frameNum / (fp_ms.count() / 1000);
+    };
+
+    if (!FLAGS_trace.empty()) {
+        Trace::Get().Start(FLAGS_trace, FLAGS_trace_events);
+        Trace::Get().name_thread("main");
     }
-    auto t2 = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> fp_ms = t2 - t1;
-    std::cout << "Time = " << fp_ms.count() << "ms" << std::endl;
-    printf("Decoded %d frames\n", frameNum);
 
-    if (bitstream.Data)
-        free(bitstream.Data);
+    if (!FLAGS_metrics.empty()) {
+        Metrics::Get().add_gauge("infer_requests_in_flight", [&] { return (double)inflight; });
+        if (tensor_cache) {
+            Metrics::Get().add_gauge("remote_tensor_cache_hits", [&] { return (double)tensor_cache->hits(); });
+            Metrics::Get().add_gauge("remote_tensor_cache_misses", [&] { return (double)tensor_cache->misses(); });
+        }
+        Metrics::Get().Start(FLAGS_metrics, std::chrono::milliseconds(FLAGS_metrics_interval_ms));
+    }
 
-    if (source)
-        fclose(source);
+    printf("Decoding VPP, and infering %s with %s\n", FLAGS_i.c_str(), FLAGS_m.c_str());
+    if (FLAGS_compare) {
+        double serial_fps = run(0);
+
+        // start over from the first frame with fresh decoder and VPP state
+        source = open_source();
+        VERIFY(source, "Could not open input file");
+        bitstream = {};
+        bitstream.CodecId = MFX_CODEC_HEVC;
+        MFXVideoVPP_Close(session);
+        MFXVideoDECODE_Close(session);
+        sts = MFXVideoDECODE_Init(session, &mfxDecParams);
+        VERIFY(MFX_ERR_NONE == sts, "Error initializing Decode");
+        sts = InitVPPWithOutputPool(session, &mfxVPPParams, output_pool);
+        VERIFY(MFX_ERR_NONE == sts, "Error initializing VPP");
+        // the new surface pool may hand out the same surface IDs
+        if (tensor_cache)
+            tensor_cache->invalidate();
+
+        double pipelined_fps = run(depth);
+        printf("Serial: %.2f fps, pipelined (depth %d): %.2f fps\n", serial_fps, depth, pipelined_fps);
+    } else {
+        double fps = run(depth);
+        if (depth == 0)
+            printf("Serial: %.2f fps\n", fps);
+        else
+            printf("Pipelined (depth %d): %.2f fps\n", depth, fps);
+    }
 
+    printf("Time to first frame: %.1f ms (model %s in %.1f ms)\n",
+           first_frame_ms.count(),
+           imported ? "imported" : "compiled",
+           load_ms.count());
+    if (tensor_cache)
+        tensor_cache->print_summary();
+    Metrics::Get().Stop();
     if (loader)
         MFXUnload(loader);
 
@@ -0,0 +1,245 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Bitstream sources feeding mfxBitstream straight from the input,
+/// without compacting or copying the encoded data on every call
+///
+/// @file
+
+#ifndef EXAMPLES_BITSTREAM_SOURCE_H_
+#define EXAMPLES_BITSTREAM_SOURCE_H_
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <memory>
+#include "utils/prefetch.h"
+#include "utils/util.h"
+
+// Base class for all encoded inputs.
+// Feed() has the same contract as ReadEncodedStream: the unconsumed part of bs
+// is kept, new data is appended behind it and MFX_ERR_MORE_DATA is returned
+// once nothing is left. bs.Data is owned by the source and must not be freed.
+class BitstreamSource {
+   public:
+    virtual ~BitstreamSource() {}
+
+    virtual mfxStatus Feed(mfxBitstream &bs) = 0;
+
+    // Read ahead on the shared I/O threads, only sources backed by a mapping use it
+    virtual void SetPrefetcher(Prefetcher *prefetcher) {}
+
+    // Whether bs.TimeStamp carries the output position of each frame
+    virtual bool HasFrameIndex() const {
+        return false;
+    }
+
+    // Time Feed() spent waiting for input data, in nanoseconds
+    unsigned long long GetStallNs() const {
+        return _prefetch ? _prefetch->stall_ns() : _stallNs;
+    }
+
+   protected:
+    std::shared_ptr<PrefetchCursor> _prefetch;
+    unsigned long long _stallNs = 0;
+};
+
+// Whole input file mapped once, shared by every source reading it.
+// The mapping is private and writable since mfxBitstream.Data is not const: the sources never
+// write to it and the pages stay shared with the page cache unless something does.
+struct FileMapping {
+    mfxU8 *base = NULL;
+    size_t size = 0;
+
+    ~FileMapping() {
+        if (base)
+            munmap(base, size);
+    }
+};
+
+// Map a regular file, returns an empty pointer for anything that cannot be mapped
+std::shared_ptr<FileMapping> MapFile(int fd) {
+    struct stat st = {};
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0)
+        return std::shared_ptr<FileMapping>();
+
+    void *base = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (base == MAP_FAILED)
+        return std::shared_ptr<FileMapping>();
+
+    madvise(base, (size_t)st.st_size, MADV_SEQUENTIAL);
+    std::shared_ptr<FileMapping> mapping(new FileMapping);
+    mapping->base = (mfxU8 *)base;
+    mapping->size = (size_t)st.st_size;
+    return mapping;
+}
+
+std::shared_ptr<FileMapping> MapFile(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return std::shared_ptr<FileMapping>();
+    std::shared_ptr<FileMapping> mapping = MapFile(fd);
+    close(fd);
+    return mapping;
+}
+
+// Regular files are mapped once and the decoder reads windows of the mapping
+// directly; moving the window only updates pointers in mfxBitstream.
+class MappedBitstreamSource : public BitstreamSource {
+   public:
+    MappedBitstreamSource(std::shared_ptr<FileMapping> mapping, mfxU32 window)
+        : _mapping(mapping),
+          _base(mapping->base),
+          _size(mapping->size),
+          _window(window),
+          _pos(0) {}
+
+    mfxStatus Feed(mfxBitstream &bs) override {
+        // whatever the decoder consumed from the previous window is skipped
+        if (bs.Data == _base + _pos)
+            _pos += bs.DataOffset;
+
+        size_t left   = _size - _pos;
+        bs.Data       = _base + _pos;
+        bs.DataOffset = 0;
+        bs.DataLength = (mfxU32)(left < _window ? left : _window);
+        bs.MaxLength  = bs.DataLength;
+        if (bs.DataLength == 0)
+            return MFX_ERR_MORE_DATA;
+
+        if (_prefetch)
+            _prefetch->require(_pos, _pos + bs.DataLength);
+        return MFX_ERR_NONE;
+    }
+
+    void SetPrefetcher(Prefetcher *prefetcher) override {
+        _prefetch = prefetcher->track(_base, _size, _mapping);
+    }
+
+   private:
+    std::shared_ptr<FileMapping> _mapping;
+    mfxU8 *_base;
+    size_t _size;
+    mfxU32 _window;
+    size_t _pos;
+};
+
+// Fallback for pipes and other non-seekable inputs.
+// The same pages are mapped twice back to back, so the buffered data is always
+// contiguous and wrapping around the end of the ring never needs a copy.
+class RingBitstreamSource : public BitstreamSource {
+   public:
+    RingBitstreamSource(int fd, mfxU32 capacity) : _fd(fd), _ring(NULL), _head(0), _tail(0), _eof(false) {
+        size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        _capacity   = (capacity + page - 1) / page * page;
+
+        int memfd = memfd_create("bitstream_ring", 0);
+        VERIFY(memfd >= 0, "memfd_create failed");
+        if (memfd < 0)
+            return;
+        if (ftruncate(memfd, _capacity) == 0) {
+            void *reserve = mmap(NULL, 2 * _capacity, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (reserve != MAP_FAILED) {
+                mfxU8 *lo = (mfxU8 *)reserve;
+                if (mmap(lo, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd, 0) != MAP_FAILED &&
+                    mmap(lo + _capacity, _capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, memfd, 0) !=
+                        MAP_FAILED)
+                    _ring = lo;
+                else
+                    munmap(reserve, 2 * _capacity);
+            }
+        }
+        close(memfd);
+        VERIFY(_ring, "Not able to map bitstream ring buffer");
+    }
+
+    ~RingBitstreamSource() {
+        if (_ring)
+            munmap(_ring, 2 * _capacity);
+        if (_fd > STDERR_FILENO)
+            close(_fd);
+    }
+
+    bool IsValid() const {
+        return _ring != NULL;
+    }
+
+    mfxStatus Feed(mfxBitstream &bs) override {
+        if (bs.Data == _ring + _head % _capacity) {
+            // a full ring the decoder took nothing from: an access unit larger than the ring
+            // would never fit, feeding the same data again would not make progress
+            if (bs.DataOffset == 0 && bs.DataLength == _capacity && _tail - _head == _capacity) {
+                printf("Access unit larger than the %zu byte bitstream ring\n", _capacity);
+                return MFX_ERR_NOT_ENOUGH_BUFFER;
+            }
+            _head += bs.DataOffset;
+        }
+
+        // Block only when nothing is buffered, otherwise top up with what is ready.
+        // Non-seekable inputs cannot be read ahead of their producer, waiting here is the I/O stall.
+        auto t1 = std::chrono::steady_clock::now();
+        bool starved = _tail == _head;
+        while (!_eof && _tail - _head < _capacity) {
+            ssize_t n = read(_fd, _ring + _tail % _capacity, _capacity - (size_t)(_tail - _head));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0) {
+                _eof = true;
+                break;
+            }
+            _tail += n;
+            if (_tail > _head)
+                break;
+        }
+        if (starved)
+            _stallNs +=
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t1).count();
+
+        bs.Data       = _ring + _head % _capacity;
+        bs.DataOffset = 0;
+        bs.DataLength = (mfxU32)(_tail - _head);
+        bs.MaxLength  = (mfxU32)_capacity;
+        if (bs.DataLength == 0)
+            return MFX_ERR_MORE_DATA;
+
+        return MFX_ERR_NONE;
+    }
+
+   private:
+    int _fd;
+    mfxU8 *_ring;
+    size_t _capacity;
+    mfxU64 _head;
+    mfxU64 _tail;
+    bool _eof;
+};
+
+// Open an encoded input: regular files are memory mapped, anything else
+// (pipes, sockets, "-" for stdin) goes through the ring buffer.
+// window is the maximum number of bytes exposed to the decoder at once.
+std::unique_ptr<BitstreamSource> OpenBitstreamSource(const char *path, mfxU32 window) {
+    int fd = IS_ARG_EQ(path, "-") ? STDIN_FILENO : open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Could not open input file %s\n", path);
+        return std::unique_ptr<BitstreamSource>();
+    }
+
+    std::shared_ptr<FileMapping> mapping = (fd != STDIN_FILENO) ? MapFile(fd) : std::shared_ptr<FileMapping>();
+    if (mapping) {
+        close(fd);
+        return std::unique_ptr<BitstreamSource>(new MappedBitstreamSource(mapping, window));
+    }
+
+    RingBitstreamSource *ring = new RingBitstreamSource(fd, window);
+    if (!ring->IsValid()) {
+        delete ring;
+        return std::unique_ptr<BitstreamSource>();
+    }
+    return std::unique_ptr<BitstreamSource>(ring);
+}
+
+#endif //EXAMPLES_BITSTREAM_SOURCE_H_
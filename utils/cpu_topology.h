@@ -0,0 +1,197 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// NUMA nodes and their CPUs from /sys, and the placement of the pipeline
+/// threads on them
+///
+/// @file
+
+#ifndef EXAMPLES_CPU_TOPOLOGY_H_
+#define EXAMPLES_CPU_TOPOLOGY_H_
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+typedef std::vector<int> CpuList;
+
+// Parse a kernel cpu list such as "0-3,8,10-11", false if it is malformed
+inline bool ParseCpuList(const std::string &text, CpuList *cpus) {
+    cpus->clear();
+    size_t pos = 0;
+    while (pos < text.size() && text[pos] != '\n') {
+        char *end = NULL;
+        long first = strtol(text.c_str() + pos, &end, 10);
+        if (end == text.c_str() + pos || first < 0)
+            return false;
+        long last = first;
+        pos = end - text.c_str();
+        if (pos < text.size() && text[pos] == '-') {
+            last = strtol(text.c_str() + pos + 1, &end, 10);
+            if (end == text.c_str() + pos + 1 || last < first)
+                return false;
+            pos = end - text.c_str();
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+            cpus->push_back((int)cpu);
+        if (pos < text.size() && text[pos] == ',')
+            pos++;
+    }
+    return true;
+}
+
+// The reverse of ParseCpuList, ranges for consecutive CPUs
+inline std::string FormatCpuList(const CpuList &cpus) {
+    std::string text;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            j++;
+        if (!text.empty())
+            text += ",";
+        text += std::to_string(cpus[i]);
+        if (j > i)
+            text += "-" + std::to_string(cpus[j]);
+        i = j + 1;
+    }
+    return text;
+}
+
+// Restrict the calling thread to cpus, threads it creates afterwards inherit them
+inline bool PinCurrentThread(const CpuList &cpus) {
+    if (cpus.empty())
+        return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// CPUs of every NUMA node the process may run on. Without /sys/devices/system/node
+// (or without any allowed CPU on it) all allowed CPUs form a single node.
+struct CpuTopology {
+    std::vector<CpuList> nodes;  // allowed CPUs of each node with any
+    std::vector<int> nodeIds;    // kernel number of each entry of nodes
+
+    static CpuTopology Read() {
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        bool restricted = sched_getaffinity(0, sizeof(allowed), &allowed) == 0;
+
+        CpuTopology topology;
+        CpuList online;
+        std::string text;
+        std::ifstream file("/sys/devices/system/node/online");
+        if (std::getline(file, text) && ParseCpuList(text, &online)) {
+            for (int node : online) {
+                std::ifstream list("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                CpuList cpus, usable;
+                if (!std::getline(list, text) || !ParseCpuList(text, &cpus))
+                    continue;
+                for (int cpu : cpus)
+                    if (!restricted || (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)))
+                        usable.push_back(cpu);
+                if (!usable.empty()) {
+                    topology.nodes.push_back(usable);
+                    topology.nodeIds.push_back(node);
+                }
+            }
+        }
+        if (topology.nodes.empty()) {
+            CpuList cpus;
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (restricted ? CPU_ISSET(cpu, &allowed) : cpu < (int)std::max(1L, sysconf(_SC_NPROCESSORS_ONLN)))
+                    cpus.push_back(cpu);
+            topology.nodes.push_back(cpus);
+            topology.nodeIds.push_back(0);
+        }
+        return topology;
+    }
+};
+
+// How the pipeline threads are placed
+enum PlacementPolicy {
+    PLACEMENT_NONE,  // nothing is pinned, the kernel moves threads freely
+    PLACEMENT_NODE,  // every thread is pinned to the CPUs of one node, streams are grouped by node
+    PLACEMENT_CORE,  // like node, but every decode worker gets a CPU of its own
+};
+
+// Parse "none", "node" or "core", returns false for anything else
+inline bool ParsePlacementPolicy(const std::string &name, PlacementPolicy *policy) {
+    if (name == "none")
+        *policy = PLACEMENT_NONE;
+    else if (name == "node")
+        *policy = PLACEMENT_NODE;
+    else if (name == "core")
+        *policy = PLACEMENT_CORE;
+    else
+        return false;
+    return true;
+}
+
+// Where the decode workers, the streams and the inference side threads go.
+// Streams form one group per node that has decode workers: stream id modulo the group count.
+// The workers of a group only run its streams, so a stream and its buffers stay on one node.
+// The inference side (batching loop, completion and postprocessing) shares inferNode.
+struct ThreadPlacement {
+    PlacementPolicy policy = PLACEMENT_NONE;
+    CpuTopology topology;
+    size_t inferNode = 0;  // index into topology.nodes
+
+    bool enabled() const {
+        return policy != PLACEMENT_NONE && !topology.nodes.empty();
+    }
+
+    // Nodes getting decode workers, a node without a worker would strand its streams
+    size_t groups(size_t workers) const {
+        if (!enabled())
+            return 1;
+        return std::max<size_t>(1, std::min(topology.nodes.size(), workers));
+    }
+
+    size_t stream_group(size_t stream_id, size_t workers) const {
+        return stream_id % groups(workers);
+    }
+
+    // Workers are dealt to the nodes round robin
+    size_t worker_group(size_t worker, size_t workers) const {
+        return worker % groups(workers);
+    }
+
+    // CPUs of worker, empty when nothing is pinned
+    CpuList worker_cpus(size_t worker, size_t workers) const {
+        if (!enabled())
+            return CpuList();
+        const CpuList &node = topology.nodes[worker_group(worker, workers)];
+        if (policy == PLACEMENT_NODE)
+            return node;
+        // the n-th worker of a node takes its n-th CPU, wrapping around when there are more workers
+        return CpuList(1, node[(worker / groups(workers)) % node.size()]);
+    }
+
+    CpuList group_cpus(size_t group) const {
+        return enabled() ? topology.nodes[group] : CpuList();
+    }
+
+    CpuList infer_cpus() const {
+        return enabled() ? topology.nodes[std::min(inferNode, topology.nodes.size() - 1)] : CpuList();
+    }
+
+    int node_id(size_t group) const {
+        return group < topology.nodeIds.size() ? topology.nodeIds[group] : 0;
+    }
+};
+
+#endif //EXAMPLES_CPU_TOPOLOGY_H_
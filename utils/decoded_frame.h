@@ -0,0 +1,28 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Decoded and scaled frame handed from the decode threads to inference
+///
+/// @file
+
+#ifndef EXAMPLES_DECODED_FRAME_H_
+#define EXAMPLES_DECODED_FRAME_H_
+
+#include <chrono>
+#include "utils/util.h"
+
+struct DecodedFrame {
+    mfxFrameSurface1 *surface; // VPP output, released once inference is done
+    size_t stream_id;
+    mfxU64 frame_index; // output position of the frame in its input file
+    double pts_ms; // presentation time of the frame at the stream frame rate
+    std::chrono::steady_clock::time_point queued; // when the frame was handed to inference
+    mfxU16 height; // decoded picture size, detections are scaled to it
+    mfxU16 width;
+};
+
+#endif //EXAMPLES_DECODED_FRAME_H_
@@ -0,0 +1,253 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Parsing and formatting of detection model output, kept free of
+/// OpenVINO so it can be benchmarked on the host
+///
+/// @file
+
+#ifndef EXAMPLES_DETECTIONS_H_
+#define EXAMPLES_DETECTIONS_H_
+
+#include <stdio.h>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+#include "utils/decoded_frame.h"
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define DETECTIONS_X86 1
+#endif
+
+#define DETECTION_SIZE 7 // image_id, label_id, confidence, x_min, y_min, x_max, y_max
+#define DETECTION_THRESHOLD 0.5f
+
+// Detections of one batch as a structure of arrays, allocated for the rows of an output once
+// and reused by every batch. Coordinates are relative until ScaleDetections() turns them into pixels.
+struct DetectionBatch {
+    size_t count = 0;
+    std::vector<int> image_id; // batch slot of the frame
+    std::vector<int> label;
+    std::vector<float> confidence;
+    std::vector<float> x_min, y_min, x_max, y_max;
+
+    // room for rows detections, only grows
+    void reserve(size_t rows) {
+        if (image_id.size() >= rows)
+            return;
+        image_id.resize(rows);
+        label.resize(rows);
+        confidence.resize(rows);
+        x_min.resize(rows);
+        y_min.resize(rows);
+        x_max.resize(rows);
+        y_max.resize(rows);
+    }
+};
+
+// Receives the detections of every batch, in pixels of each frame, on a postprocessing thread
+typedef std::function<void(const std::vector<DecodedFrame> &frames, const DetectionBatch &detections)> DetectionConsumer;
+
+// Instruction sets of the parser, the best one the CPU has is picked at runtime
+enum DetectionIsa {
+    DETECTION_SCALAR,
+    DETECTION_AVX2,
+    DETECTION_AVX512,
+};
+
+inline DetectionIsa BestDetectionIsa() {
+#ifdef DETECTIONS_X86
+    // the AVX2 paths of the YOLO decoding use FMA as well
+    static const DetectionIsa best =
+        __builtin_cpu_supports("avx512f")                                   ? DETECTION_AVX512
+        : __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") ? DETECTION_AVX2
+                                                                            : DETECTION_SCALAR;
+    return best;
+#else
+    return DETECTION_SCALAR;
+#endif
+}
+
+inline const char *DetectionIsaName(DetectionIsa isa) {
+    return isa == DETECTION_AVX512 ? "avx512" : isa == DETECTION_AVX2 ? "avx2" : "scalar";
+}
+
+// Rows [first, rows) one by one, returns false at the end marker
+inline bool ParseDetectionRows(const float *output, size_t first, size_t rows, float threshold, DetectionBatch &batch) {
+    for (size_t i = first; i < rows; i++) {
+        const float *row = output + i * DETECTION_SIZE;
+        int image_id     = static_cast<int>(row[0]);
+        if (image_id < 0)
+            return false;
+        if (row[2] < threshold)
+            continue;
+        size_t n            = batch.count++;
+        batch.image_id[n]   = image_id;
+        batch.label[n]      = static_cast<int>(row[1]);
+        batch.confidence[n] = row[2];
+        batch.x_min[n]      = row[3];
+        batch.y_min[n]      = row[4];
+        batch.x_max[n]      = row[5];
+        batch.y_max[n]      = row[6];
+    }
+    return true;
+}
+
+#ifdef DETECTIONS_X86
+// Append the rows of block set in keep, lowest first
+inline void CopyDetectionRows(const float *block, unsigned keep, DetectionBatch &batch) {
+    for (; keep; keep &= keep - 1) {
+        const float *row    = block + __builtin_ctz(keep) * DETECTION_SIZE;
+        size_t n            = batch.count++;
+        batch.image_id[n]   = static_cast<int>(row[0]);
+        batch.label[n]      = static_cast<int>(row[1]);
+        batch.confidence[n] = row[2];
+        batch.x_min[n]      = row[3];
+        batch.y_min[n]      = row[4];
+        batch.x_max[n]      = row[5];
+        batch.y_max[n]      = row[6];
+    }
+}
+
+// Column c of 8 rows. Element loads are faster here than a gather, which is microcoded
+// on many CPUs; the compiler turns them into loads and lane inserts.
+__attribute__((target("avx2"))) inline __m256 DetectionColumn8(const float *p, int c) {
+    return _mm256_setr_ps(p[c], p[7 + c], p[14 + c], p[21 + c], p[28 + c], p[35 + c], p[42 + c], p[49 + c]);
+}
+
+// 8 rows per step: one compare of the image_id and confidence columns yields the kept rows and
+// the end marker, the branches per row of the scalar loop (mispredicted for random scores) are gone
+__attribute__((target("avx2"))) inline void ParseDetectionsAvx2(const float *output, size_t rows, float threshold,
+                                                                DetectionBatch &batch) {
+    const __m256 limit = _mm256_set1_ps(threshold);
+    const __m256 last  = _mm256_set1_ps(-1.0f);  // an image_id truncates to a negative int from -1 down
+    size_t i           = 0;
+    for (; i + 8 <= rows; i += 8) {
+        const float *block = output + i * DETECTION_SIZE;
+        int end            = _mm256_movemask_ps(_mm256_cmp_ps(DetectionColumn8(block, 0), last, _CMP_LE_OQ));
+        // not-less-than keeps the rows the scalar "< threshold" test keeps, NaN included
+        int keep = _mm256_movemask_ps(_mm256_cmp_ps(DetectionColumn8(block, 2), limit, _CMP_NLT_UQ));
+        if (end)
+            keep &= (1 << __builtin_ctz(end)) - 1;
+        CopyDetectionRows(block, (unsigned)keep, batch);
+        if (end)
+            return;
+    }
+    ParseDetectionRows(output, i, rows, threshold, batch);
+}
+
+__attribute__((target("avx512f"))) inline __m512 DetectionColumn16(const float *p, int c) {
+    return _mm512_setr_ps(p[c], p[7 + c], p[14 + c], p[21 + c], p[28 + c], p[35 + c], p[42 + c], p[49 + c],
+                          p[56 + c], p[63 + c], p[70 + c], p[77 + c], p[84 + c], p[91 + c], p[98 + c], p[105 + c]);
+}
+
+// Same as the AVX2 parser with 16 rows per step and mask registers
+__attribute__((target("avx512f"))) inline void ParseDetectionsAvx512(const float *output, size_t rows, float threshold,
+                                                                     DetectionBatch &batch) {
+    const __m512 limit = _mm512_set1_ps(threshold);
+    const __m512 last  = _mm512_set1_ps(-1.0f);
+    size_t i           = 0;
+    for (; i + 16 <= rows; i += 16) {
+        const float *block = output + i * DETECTION_SIZE;
+        __mmask16 end      = _mm512_cmp_ps_mask(DetectionColumn16(block, 0), last, _CMP_LE_OQ);
+        __mmask16 keep     = _mm512_cmp_ps_mask(DetectionColumn16(block, 2), limit, _CMP_NLT_UQ);
+        if (end)
+            keep &= (__mmask16)((1u << __builtin_ctz(end)) - 1);
+        CopyDetectionRows(block, keep, batch);
+        if (end)
+            return;
+    }
+    ParseDetectionRows(output, i, rows, threshold, batch);
+}
+#endif
+
+// Detections of an SSD-style output of rows rows above threshold, compacted into batch.
+// The list ends at the first negative image_id, no row after it is looked at.
+inline void ParseDetections(const float *output,
+                            size_t rows,
+                            float threshold,
+                            DetectionBatch &batch,
+                            DetectionIsa isa = BestDetectionIsa()) {
+    batch.reserve(rows);
+    batch.count = 0;
+#ifdef DETECTIONS_X86
+    if (isa == DETECTION_AVX512) {
+        ParseDetectionsAvx512(output, rows, threshold, batch);
+        return;
+    }
+    if (isa == DETECTION_AVX2) {
+        ParseDetectionsAvx2(output, rows, threshold, batch);
+        return;
+    }
+#endif
+    ParseDetectionRows(output, 0, rows, threshold, batch);
+}
+
+// Coordinates to pixels of the frame in each batch slot, detections of padding slots are dropped
+inline void ScaleDetections(DetectionBatch &batch, const std::vector<DecodedFrame> &frames) {
+    size_t kept = 0;
+    for (size_t i = 0; i < batch.count; i++) {
+        int slot = batch.image_id[i];
+        if (slot >= (int)frames.size())
+            continue;
+        float width            = frames[slot].width;
+        float height           = frames[slot].height;
+        batch.image_id[kept]   = slot;
+        batch.label[kept]      = batch.label[i];
+        batch.confidence[kept] = batch.confidence[i];
+        batch.x_min[kept]      = batch.x_min[i] * width;
+        batch.y_min[kept]      = batch.y_min[i] * height;
+        batch.x_max[kept]      = batch.x_max[i] * width;
+        batch.y_max[kept]      = batch.y_max[i] * height;
+        kept++;
+    }
+    batch.count = kept;
+}
+
+// Same scale for every slot, for a single stream
+inline void ScaleDetections(DetectionBatch &batch, float width, float height) {
+    for (size_t i = 0; i < batch.count; i++) {
+        batch.x_min[i] *= width;
+        batch.y_min[i] *= height;
+        batch.x_max[i] *= width;
+        batch.y_max[i] *= height;
+    }
+}
+
+// One text block per batch slot: the frame followed by its boxes, detections already in pixels
+inline std::vector<std::string> FormatDetections(const DetectionBatch &detections,
+                                                 const std::vector<DecodedFrame> &batched_frames) {
+    std::vector<std::string> results(batched_frames.size());
+    char line[256];
+    for (size_t b = 0; b < batched_frames.size(); b++) {
+        snprintf(line,
+                 sizeof(line),
+                 "Frame %llu [stream_id=%zu %.0f ms]\n",
+                 (unsigned long long)batched_frames[b].frame_index,
+                 batched_frames[b].stream_id,
+                 batched_frames[b].pts_ms);
+        results[b] = line;
+    }
+    for (size_t i = 0; i < detections.count; i++) {
+        int slot = detections.image_id[i];
+        if (slot < 0 || slot >= (int)batched_frames.size())
+            continue;
+        snprintf(line,
+                 sizeof(line),
+                 "  bbox %.2f, %.2f, %.2f, %.2f, confidence = %.5f\n",
+                 detections.x_min[i],
+                 detections.y_min[i],
+                 detections.x_max[i],
+                 detections.y_max[i],
+                 detections.confidence[i]);
+        results[slot] += line;
+    }
+    return results;
+}
+
+#endif //EXAMPLES_DETECTIONS_H_
@@ -2,6 +2,9 @@
 #include <openvino/runtime/intel_gpu/ocl/va.hpp>
 #include <openvino/runtime/intel_gpu/properties.hpp>
 #include <openvino/core/preprocess/pre_post_process.hpp>
+#include "utils/decoded_frame.h"
+#include "utils/detections.h"
+#include "utils/yolo.h"
 #include "utils/util.h"
 
 using namespace ov::preprocess;
@@ -10,13 +13,15 @@ mfxStatus sts = MFX_ERR_NONE;
 #define MAJOR_API_VERSION_REQUIRED 2
 #define MINOR_API_VERSION_REQUIRED 2
 
-bool openvino_preprocess(std::shared_ptr<ov::Model> model)
+// remote: the NV12 planes come as VA surfaces, otherwise as host tensors
+bool openvino_preprocess(std::shared_ptr<ov::Model> model, bool remote = true)
 {
     auto p = PrePostProcessor(model);
     p.input().tensor().set_element_type(ov::element::u8)
         // YUV images can be split into separate planes
-        .set_color_format(ov::preprocess::ColorFormat::NV12_TWO_PLANES, {"y", "uv"})
-        .set_memory_type(ov::intel_gpu::memory_type::surface);
+        .set_color_format(ov::preprocess::ColorFormat::NV12_TWO_PLANES, {"y", "uv"});
+    if (remote)
+        p.input().tensor().set_memory_type(ov::intel_gpu::memory_type::surface);
     // Change color format
     p.input().preprocess().convert_color(ov::preprocess::ColorFormat::BGR);
     // Change layout
@@ -25,7 +30,7 @@ bool openvino_preprocess(std::shared_ptr<ov::Model> model)
     return true;
 }
 
-ov::Tensor openvino_infer(std::pair<ov::intel_gpu::ocl::VASurfaceTensor, ov::intel_gpu::ocl::VASurfaceTensor> nv12_blob, std::shared_ptr<ov::Model> &model, ov::InferRequest infer_request)
+ov::Tensor openvino_infer(std::pair<ov::Tensor, ov::Tensor> nv12_blob, std::shared_ptr<ov::Model> &model, ov::InferRequest infer_request)
 {   
     // get the new inputs, one for Y and another for UV
     auto new_input0 = model->get_parameters().at(0);
@@ -43,34 +48,43 @@ ov::Tensor openvino_infer(std::pair<ov::intel_gpu::ocl::VASurfaceTensor, ov::int
     return output_tensor;
 }
 
+// Wrap the NV12 planes of a system memory surface as host tensors without copying, one for Y and another for UV.
+// The surface stays mapped for reading, unmap it once the inference using the tensors completed.
+std::pair<ov::Tensor, ov::Tensor> WrapNV12HostTensors(mfxFrameSurface1 *surface, size_t height, size_t width)
+{
+    sts = surface->FrameInterface->Map(surface, MFX_MAP_READ);
+    VERIFY(MFX_ERR_NONE == sts, "mfxFrameSurfaceInterface->Map failed");
+    // strides in bytes, rows are Pitch apart
+    size_t pitch = surface->Data.Pitch;
+    ov::Tensor y(ov::element::u8, {1, height, width, 1}, surface->Data.Y, {pitch * height, pitch, 1, 1});
+    ov::Tensor uv(ov::element::u8, {1, height / 2, width / 2, 2}, surface->Data.UV, {pitch * height / 2, pitch, 2, 1});
+    return std::make_pair(y, uv);
+}
+
+// Parse a detection output [.., N, 7] into batch, false (and no detections) for any other model
+bool ParseDetectionOutput(ov::Tensor output_tensor, DetectionBatch &batch)
+{
+    batch.count = 0;
+    size_t last_dim = output_tensor.get_shape().back();
+    if (last_dim != DETECTION_SIZE)
+        return false;
+    // suppose object detection model with output [image_id, label_id, confidence, bbox coordinates]
+    ParseDetections((const float *)output_tensor.data(), output_tensor.get_size() / last_dim, DETECTION_THRESHOLD, batch);
+    return true;
+}
+
 void PrintSingleResults(ov::Tensor output_tensor, mfxU16 width, mfxU16 height)
 {
-    float *output = (float *)output_tensor.data();
     /* Each detection has image_id that denotes processed image */
-    size_t last_dim = output_tensor.get_shape().back();
-    if (last_dim == 7)
+    static thread_local DetectionBatch detections;
+    if (ParseDetectionOutput(output_tensor, detections))
     {
-        // suppose object detection model with output [image_id, label_id, confidence, bbox coordinates]
-        float *output = (float *)output_tensor.data();
-        for (size_t i = 0; i < output_tensor.get_size() / last_dim; i++)
+        ScaleDetections(detections, width, height);
+        for (size_t i = 0; i < detections.count; i++)
         {
-            int image_id = static_cast<int>(output[i * last_dim + 0]);
-            if (image_id < 0)
-                break;
-
-            float confidence = output[i * last_dim + 2];
-
-            if (confidence < 0.5)
-            {
-                continue;
-            }
-
-            float x_min = output[i * last_dim + 3] * width;
-            float y_min = output[i * last_dim + 4] * height;
-            float x_max = output[i * last_dim + 5] * width;
-            float y_max = output[i * last_dim + 6] * height;
-            printf("  image%d: bbox %.2f, %.2f, %.2f, %.2f, confidence = %.5f\n", image_id, x_min, y_min, x_max, y_max,
-                   confidence);
+            printf("  image%d: bbox %.2f, %.2f, %.2f, %.2f, confidence = %.5f\n", detections.image_id[i],
+                   detections.x_min[i], detections.y_min[i], detections.x_max[i], detections.y_max[i],
+                   detections.confidence[i]);
         }
     }
     else
@@ -79,50 +93,72 @@ void PrintSingleResults(ov::Tensor output_tensor, mfxU16 width, mfxU16 height)
     }
 }
 
-void PrintMultiResults(ov::Tensor output_tensor, std::vector<std::pair<mfxFrameSurface1*, size_t>> batched_frames, std::vector<std::pair<mfxU16, mfxU16>> shape)
+// Detections of raw YOLO heads: every output is [batch, anchors * (5 + classes), height, width]
+// and takes the anchors of config in order of its grid, the finest first. False if the outputs
+// do not fit the anchors.
+bool ParseYoloOutputs(const std::vector<ov::Tensor> &outputs, const YoloConfig &config, DetectionBatch &detections)
 {
-    printf("Frames");
-    for (auto frame : batched_frames)
+    detections.count = 0;
+    std::vector<const ov::Tensor *> sorted;
+    for (auto &output : outputs)
     {
-        printf(" [stream_id=%ld]", frame.second);
+        if (output.get_shape().size() != 4 || output.get_element_type() != ov::element::f32)
+            return false;
+        sorted.push_back(&output);
     }
-    printf("\n");
-    // If object detection model, print bounding box coordinates and confidence. Otherwise, print output shape
-    size_t last_dim = output_tensor.get_shape().back();
-    if (last_dim == 7)
+    if (sorted.empty() || sorted.size() != config.anchors.size())
+        return false;
+    std::stable_sort(sorted.begin(), sorted.end(), [](const ov::Tensor *a, const ov::Tensor *b) {
+        return a->get_shape()[2] * a->get_shape()[3] > b->get_shape()[2] * b->get_shape()[3];
+    });
+
+    std::vector<YoloHead> heads;
+    for (size_t k = 0; k < sorted.size(); k++)
     {
-        // suppose object detection model with output [image_id, label_id, confidence, bbox coordinates]
-        float *output = (float *)output_tensor.data();
-        for (size_t i = 0; i < output_tensor.get_size() / last_dim; i++)
-        {
-            int image_id = static_cast<int>(output[i * last_dim + 0]);
-            int batch_id = batched_frames[image_id].second;
-            if (image_id < 0)
-                break;
-
-            float confidence = output[i * last_dim + 2];
-
-            if (confidence < 0.5)
-            {
-                continue;
-            }
-
-            float x_min = output[i * last_dim + 3] * shape[batch_id].second;
-            float y_min = output[i * last_dim + 4] * shape[batch_id].first;
-            float x_max = output[i * last_dim + 5] * shape[batch_id].second;
-            float y_max = output[i * last_dim + 6] * shape[batch_id].first;
-            printf("image%d: bbox %.2f, %.2f, %.2f, %.2f, confidence = %.5f\n", image_id, x_min, y_min, x_max, y_max,
-                   confidence);
-        }
+        ov::Shape shape = sorted[k]->get_shape();
+        size_t anchors = config.anchors[k].size() / 2;
+        if (shape[0] != sorted[0]->get_shape()[0] || shape[1] % anchors || shape[1] / anchors <= YOLO_BOX_SIZE)
+            return false;
+        heads.push_back({(const float *)sorted[k]->data(), shape[0], anchors, shape[1] / anchors - YOLO_BOX_SIZE,
+                         shape[2], shape[3], config.anchors[k].data()});
     }
-    else
+    static thread_local YoloScratch scratch;
+    DecodeYolo(heads, config, detections, scratch);
+    return true;
+}
+
+// Detections of a batch in pixels of each frame, from an SSD output [.., N, 7] or raw YOLO heads;
+// false for any other model. Slots past the real frames pad a partial batch, their detections are dropped.
+bool ParseMultiResults(const std::vector<ov::Tensor> &outputs, const YoloConfig &yolo,
+                       const std::vector<DecodedFrame> &batched_frames, DetectionBatch &detections)
+{
+    bool parsed = outputs.size() == 1 && ParseDetectionOutput(outputs[0], detections);
+    if (!parsed)
+        parsed = ParseYoloOutputs(outputs, yolo, detections);
+    if (!parsed)
+        return false;
+    ScaleDetections(detections, batched_frames);
+    return true;
+}
+
+void PrintMultiResults(const std::vector<DecodedFrame> &batched_frames, const DetectionBatch &detections)
+{
+    printf("Frames");
+    for (auto &frame : batched_frames)
     {
-        std::cout << "  output shape=" << output_tensor.get_shape() << std::endl;
+        printf(" [stream_id=%zu frame=%llu %.0f ms]", frame.stream_id, (unsigned long long)frame.frame_index, frame.pts_ms);
+    }
+    printf("\n");
+    for (size_t i = 0; i < detections.count; i++)
+    {
+        printf("image%d: bbox %.2f, %.2f, %.2f, %.2f, confidence = %.5f\n", detections.image_id[i],
+               detections.x_min[i], detections.y_min[i], detections.x_max[i], detections.y_max[i],
+               detections.confidence[i]);
     }
 }
 
-
-mfxSession CreateVPLSession(mfxLoader *loader)
+// software selects the oneVPL CPU runtime, for system memory surfaces
+mfxSession CreateVPLSession(mfxLoader *loader, bool software = false)
 {
 
     // variables used only in 2.x version
@@ -134,11 +170,11 @@ mfxSession CreateVPLSession(mfxLoader *loader)
     *loader = MFXLoad();
     VERIFY2(NULL != *loader, "MFXLoad failed -- is implementation in path?\n");
 
-    // Implementation used must be the hardware implementation
+    // Implementation used must be the hardware implementation, or the CPU runtime
     cfg[0] = MFXCreateConfig(*loader);
     VERIFY2(NULL != cfg[0], "MFXCreateConfig failed")
     cfgVal.Type = MFX_VARIANT_TYPE_U32;
-    cfgVal.Data.U32 = MFX_IMPL_TYPE_HARDWARE;
+    cfgVal.Data.U32 = software ? MFX_IMPL_TYPE_SOFTWARE : MFX_IMPL_TYPE_HARDWARE;
     sts = MFXSetConfigFilterProperty(cfg[0], (mfxU8 *)"mfxImplDescription.Impl", cfgVal);
     VERIFY2(MFX_ERR_NONE == sts, "MFXSetConfigFilterProperty failed for Impl");
 
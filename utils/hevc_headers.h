@@ -0,0 +1,190 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Minimal HEVC header parsing: the SPS, PPS and slice header fields
+/// needed to derive the picture order count (H.265 8.3.1)
+///
+/// @file
+
+#ifndef EXAMPLES_HEVC_HEADERS_H_
+#define EXAMPLES_HEVC_HEADERS_H_
+
+#include "utils/util.h"
+
+#define HEVC_MAX_SPS 16
+#define HEVC_MAX_PPS 64
+
+// Reads an RBSP from a NAL unit payload, emulation prevention bytes (00 00 03) are dropped on the fly.
+// Reading past the end returns zeros and sets the error flag.
+class HevcBitReader {
+   public:
+    HevcBitReader(const mfxU8 *data, size_t size) : _data(data), _size(size) {}
+
+    mfxU32 u(int n) {
+        mfxU32 value = 0;
+        while (n--)
+            value = (value << 1) | bit();
+        return value;
+    }
+
+    // Exp-Golomb coded unsigned value
+    mfxU32 ue() {
+        int leading_zeros = 0;
+        while (!bit() && !_error) {
+            if (++leading_zeros >= 32) {
+                _error = true;
+                return 0;
+            }
+        }
+        return ((1u << leading_zeros) - 1) + u(leading_zeros);
+    }
+
+    void skip(int n) {
+        while (n--)
+            bit();
+    }
+
+    bool error() const {
+        return _error;
+    }
+
+   private:
+    mfxU32 bit() {
+        if (_bits == 0) {
+            if (_pos < _size && _zeros >= 2 && _data[_pos] == 3) {
+                _pos++;
+                _zeros = 0;
+            }
+            if (_pos >= _size) {
+                _error = true;
+                return 0;
+            }
+            _byte  = _data[_pos++];
+            _zeros = _byte ? 0 : _zeros + 1;
+            _bits  = 8;
+        }
+        return (_byte >> --_bits) & 1;
+    }
+
+    const mfxU8 *_data;
+    size_t _size;
+    size_t _pos  = 0;
+    int _zeros   = 0;
+    mfxU8 _byte  = 0;
+    int _bits    = 0;
+    bool _error  = false;
+};
+
+struct HevcSps {
+    bool valid;
+    bool separate_colour_plane;
+    mfxU32 log2_max_poc_lsb;
+};
+
+struct HevcPps {
+    bool valid;
+    mfxU32 sps_id;
+    bool output_flag_present;
+    mfxU32 num_extra_slice_header_bits;
+};
+
+// Slice header fields of the first slice segment of a picture
+struct HevcSliceHeader {
+    mfxU32 poc_lsb;
+    mfxU32 log2_max_poc_lsb; // from the active SPS
+    bool pic_output;
+};
+
+// data/size: NAL unit without start code, header included
+bool ParseHevcSps(const mfxU8 *data, size_t size, HevcSps sps[HEVC_MAX_SPS]) {
+    if (size < 3)
+        return false;
+    HevcBitReader br(data + 2, size - 2);
+    br.skip(4); // sps_video_parameter_set_id
+    mfxU32 max_sub_layers_minus1 = br.u(3);
+    br.skip(1); // sps_temporal_id_nesting_flag
+
+    // profile_tier_level(1, sps_max_sub_layers_minus1)
+    br.skip(88 + 8);
+    bool sub_profile[8] = {}, sub_level[8] = {};
+    for (mfxU32 i = 0; i < max_sub_layers_minus1; i++) {
+        sub_profile[i] = br.u(1);
+        sub_level[i]   = br.u(1);
+    }
+    if (max_sub_layers_minus1 > 0)
+        br.skip(2 * (8 - max_sub_layers_minus1));
+    for (mfxU32 i = 0; i < max_sub_layers_minus1; i++)
+        br.skip((sub_profile[i] ? 88 : 0) + (sub_level[i] ? 8 : 0));
+
+    mfxU32 id = br.ue();
+    if (br.error() || id >= HEVC_MAX_SPS)
+        return false;
+    HevcSps s               = {};
+    s.separate_colour_plane = br.ue() == 3 && br.u(1);
+    br.ue(); // pic_width_in_luma_samples
+    br.ue(); // pic_height_in_luma_samples
+    if (br.u(1)) {
+        for (int i = 0; i < 4; i++)
+            br.ue(); // conformance window offsets
+    }
+    br.ue(); // bit_depth_luma_minus8
+    br.ue(); // bit_depth_chroma_minus8
+    s.log2_max_poc_lsb = br.ue() + 4;
+    s.valid            = !br.error() && s.log2_max_poc_lsb <= 16;
+    sps[id]            = s;
+    return s.valid;
+}
+
+bool ParseHevcPps(const mfxU8 *data, size_t size, HevcPps pps[HEVC_MAX_PPS]) {
+    if (size < 3)
+        return false;
+    HevcBitReader br(data + 2, size - 2);
+    mfxU32 id = br.ue();
+    if (br.error() || id >= HEVC_MAX_PPS)
+        return false;
+    HevcPps p  = {};
+    p.sps_id   = br.ue();
+    br.skip(1); // dependent_slice_segments_enabled_flag
+    p.output_flag_present         = br.u(1);
+    p.num_extra_slice_header_bits = br.u(3);
+    p.valid                       = !br.error() && p.sps_id < HEVC_MAX_SPS;
+    pps[id]                       = p;
+    return p.valid;
+}
+
+// Parse the start of the first slice segment of a picture up to slice_pic_order_cnt_lsb
+bool ParseHevcSliceHeader(const mfxU8 *data,
+                          size_t size,
+                          const HevcSps sps[HEVC_MAX_SPS],
+                          const HevcPps pps[HEVC_MAX_PPS],
+                          HevcSliceHeader *slice) {
+    if (size < 3)
+        return false;
+    mfxU8 type = (data[0] >> 1) & 0x3f;
+    HevcBitReader br(data + 2, size - 2);
+    if (!br.u(1)) // first_slice_segment_in_pic_flag
+        return false;
+    if (type >= 16 && type <= 23)
+        br.skip(1); // no_output_of_prior_pics_flag
+    mfxU32 pps_id = br.ue();
+    if (br.error() || pps_id >= HEVC_MAX_PPS || !pps[pps_id].valid || !sps[pps[pps_id].sps_id].valid)
+        return false;
+    const HevcPps &p = pps[pps_id];
+    const HevcSps &s = sps[p.sps_id];
+
+    br.skip(p.num_extra_slice_header_bits); // slice_reserved_flag
+    br.ue();                                // slice_type
+    slice->pic_output = p.output_flag_present ? br.u(1) != 0 : true;
+    if (s.separate_colour_plane)
+        br.skip(2); // colour_plane_id
+    slice->log2_max_poc_lsb = s.log2_max_poc_lsb;
+    // IDR pictures have no POC LSB, it is 0
+    slice->poc_lsb          = (type == 19 || type == 20) ? 0 : br.u(s.log2_max_poc_lsb);
+    return !br.error();
+}
+
+#endif //EXAMPLES_HEVC_HEADERS_H_
@@ -0,0 +1,648 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// HEVC access unit index: start code scanning, IDR and parameter set
+/// positions, persisted next to the input file as <input>.idx
+///
+/// @file
+
+#ifndef EXAMPLES_HEVC_INDEX_H_
+#define EXAMPLES_HEVC_INDEX_H_
+
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+#endif
+#include "utils/bitstream_source.h"
+#include "utils/hevc_headers.h"
+
+#define HEVC_INDEX_MAGIC    "HEVCIDX1"
+#define HEVC_INDEX_SUFFIX   ".idx"
+#define HEVC_START_CODE_LEN 3
+#define HEVC_NOT_DISPLAYED  0xffffffff
+
+// NAL unit types used by the indexer (H.265 table 7-1)
+enum HevcNalType {
+    HEVC_NAL_RSV_VCL_N14 = 14,
+    HEVC_NAL_BLA_W_LP    = 16,
+    HEVC_NAL_IDR_W_RADL  = 19,
+    HEVC_NAL_IDR_N_LP    = 20,
+    HEVC_NAL_CRA_NUT     = 21,
+    HEVC_NAL_RSV_IRAP_23 = 23,
+    HEVC_NAL_VPS         = 32,
+    HEVC_NAL_SPS         = 33,
+    HEVC_NAL_PPS         = 34,
+    HEVC_NAL_AUD         = 35,
+    HEVC_NAL_PREFIX_SEI  = 39,
+};
+
+// Pictures handed to the decoder
+enum HevcDecodeMode {
+    HEVC_DECODE_ALL,       // every picture
+    HEVC_DECODE_REFERENCE, // skip sub-layer non-reference pictures of the highest temporal layer
+    HEVC_DECODE_KEY,       // IRAP pictures only (IDR, CRA, BLA)
+};
+
+// Parse "all", "ref" or "key", returns false for anything else
+bool ParseHevcDecodeMode(const std::string &name, HevcDecodeMode *mode) {
+    if (name == "all")
+        *mode = HEVC_DECODE_ALL;
+    else if (name == "ref")
+        *mode = HEVC_DECODE_REFERENCE;
+    else if (name == "key")
+        *mode = HEVC_DECODE_KEY;
+    else
+        return false;
+    return true;
+}
+
+// Access unit flags
+enum {
+    HEVC_AU_IRAP      = 0x1, // IDR, CRA or BLA picture
+    HEVC_AU_IDR       = 0x2, // closed GOP, decoding can start here
+    HEVC_AU_PARAMS    = 0x4, // carries VPS/SPS/PPS
+    HEVC_AU_REFERENCE = 0x8, // not a sub-layer non-reference picture
+};
+
+// On-disk layout, keep the size of the structs fixed
+struct HevcAccessUnit {
+    mfxU64 offset; // first byte of the access unit, start code included
+    mfxU32 size;
+    mfxU8 nal_type; // type of the first VCL NAL unit
+    mfxU8 temporal_id;
+    mfxU16 flags;
+};
+
+struct HevcParameterSet {
+    mfxU64 offset;
+    mfxU32 size;
+    mfxU8 nal_type;
+    mfxU8 reserved[3];
+};
+
+struct HevcIndexHeader {
+    char magic[8];
+    mfxU64 file_size;
+    mfxI64 file_mtime_ns;
+    mfxU32 num_units;
+    mfxU32 num_params;
+};
+
+//-- Start code scanning
+// All variants return the offset of the next 00 00 01 at or after pos, or size if there is none
+size_t FindStartCodeScalar(const mfxU8 *p, size_t pos, size_t size) {
+    for (; pos + HEVC_START_CODE_LEN <= size; pos++) {
+        if (p[pos + 2] > 1) {
+            pos += 2;
+            continue;
+        }
+        if (p[pos] == 0 && p[pos + 1] == 0 && p[pos + 2] == 1)
+            return pos;
+    }
+    return size;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+// Compare three shifted loads at once: byte i starts a start code when
+// p[i] == 0, p[i + 1] == 0 and p[i + 2] == 1
+__attribute__((target("sse2"))) size_t FindStartCodeSSE2(const mfxU8 *p, size_t pos, size_t size) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one  = _mm_set1_epi8(1);
+    for (; pos + 16 + 2 <= size; pos += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(p + pos));
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + pos + 1));
+        __m128i c = _mm_loadu_si128((const __m128i *)(p + pos + 2));
+        __m128i m = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(b, zero)),
+                                  _mm_cmpeq_epi8(c, one));
+        int mask = _mm_movemask_epi8(m);
+        if (mask)
+            return pos + __builtin_ctz(mask);
+    }
+    return FindStartCodeScalar(p, pos, size);
+}
+
+__attribute__((target("avx2"))) size_t FindStartCodeAVX2(const mfxU8 *p, size_t pos, size_t size) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one  = _mm256_set1_epi8(1);
+    for (; pos + 32 + 2 <= size; pos += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(p + pos));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + pos + 1));
+        __m256i c = _mm256_loadu_si256((const __m256i *)(p + pos + 2));
+        __m256i m = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(b, zero)),
+                                     _mm256_cmpeq_epi8(c, one));
+        unsigned int mask = (unsigned int)_mm256_movemask_epi8(m);
+        if (mask)
+            return pos + __builtin_ctz(mask);
+    }
+    return FindStartCodeSSE2(p, pos, size);
+}
+#endif
+
+typedef size_t (*FindStartCodeFn)(const mfxU8 *, size_t, size_t);
+
+// Pick the widest scanner the CPU supports, resolved once
+FindStartCodeFn GetFindStartCode() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return FindStartCodeAVX2;
+    if (__builtin_cpu_supports("sse2"))
+        return FindStartCodeSSE2;
+#endif
+    return FindStartCodeScalar;
+}
+
+class HevcIndex {
+   public:
+    std::vector<HevcAccessUnit> units;
+    std::vector<HevcParameterSet> params;
+    std::vector<mfxU32> idr; // indices into units, derived from the flags
+    std::vector<mfxU32> display; // output position of every access unit, empty if the headers could not be parsed
+    mfxU8 max_temporal_id = 0;
+
+    size_t FrameCount() const {
+        return units.size();
+    }
+
+    // Whether access unit au is decoded in mode, the skipped ones are never referenced by the others
+    bool IsDecoded(mfxU32 au, HevcDecodeMode mode) const {
+        const HevcAccessUnit &unit = units[au];
+        switch (mode) {
+            case HEVC_DECODE_KEY:
+                return (unit.flags & HEVC_AU_IRAP) != 0;
+            case HEVC_DECODE_REFERENCE:
+                // a sub-layer non-reference picture may still be referenced from a higher sub-layer
+                return (unit.flags & HEVC_AU_REFERENCE) || unit.temporal_id < max_temporal_id;
+            default:
+                return true;
+        }
+    }
+
+    // Position of access unit au in output order, falls back to the decode order
+    mfxU32 DisplayIndex(mfxU32 au) const {
+        return display.empty() ? au : display[au];
+    }
+
+    // Number of output positions, pictures that are never output take none
+    mfxU32 OutputCount() const {
+        if (display.empty())
+            return (mfxU32)units.size();
+        return (mfxU32)(units.size() - std::count(display.begin(), display.end(), HEVC_NOT_DISPLAYED));
+    }
+
+    // Lowest output position of the pictures decoded from access unit au on, OutputCount() if none
+    // is output. From an IDR on this is where the output of its sequence starts, leading pictures
+    // are output before the IDR itself.
+    mfxU32 FirstOutputFrom(mfxU32 au) const {
+        if (display.empty())
+            return std::min(au, (mfxU32)units.size());
+        mfxU32 first = OutputCount();
+        for (mfxU32 i = au; i < display.size(); i++)
+            if (display[i] != HEVC_NOT_DISPLAYED)
+                first = std::min(first, display[i]);
+        return first;
+    }
+
+    // Derive the output order from the picture order counts (H.265 8.3.1).
+    // Pictures of a coded video sequence are output before the next one starts, ordered by POC.
+    // RASL pictures of a CRA starting the stream are never output (HEVC_NOT_DISPLAYED).
+    void UpdateDisplayOrder(const mfxU8 *data, size_t size) {
+        static const FindStartCodeFn find_start_code = GetFindStartCode();
+        display.assign(units.size(), HEVC_NOT_DISPLAYED);
+
+        HevcSps sps[HEVC_MAX_SPS] = {};
+        HevcPps pps[HEVC_MAX_PPS] = {};
+        size_t next_param         = 0;
+        mfxI32 prev_tid0_poc      = 0;
+        bool skip_rasl            = false;
+        mfxU32 output_base        = 0;
+        std::vector<std::pair<mfxI32, mfxU32>> sequence; // (POC, access unit) of the current sequence
+
+        for (mfxU32 i = 0; i <= units.size(); i++) {
+            bool new_sequence = i == units.size() || (units[i].flags & HEVC_AU_IDR) ||
+                                (units[i].nal_type >= HEVC_NAL_BLA_W_LP && units[i].nal_type < HEVC_NAL_IDR_W_RADL) ||
+                                (i == 0 && (units[i].flags & HEVC_AU_IRAP));
+            if (new_sequence) {
+                std::stable_sort(sequence.begin(), sequence.end());
+                for (size_t j = 0; j < sequence.size(); j++)
+                    display[sequence[j].second] = output_base + (mfxU32)j;
+                output_base += (mfxU32)sequence.size();
+                sequence.clear();
+            }
+            if (i == units.size())
+                break;
+
+            // first slice segment of the picture, the parameter sets before it are active;
+            // the headers are only read within data, an index not matching it gives no display order
+            const HevcAccessUnit &unit = units[i];
+            if (unit.offset > size || unit.size > size - unit.offset) {
+                display.clear();
+                return;
+            }
+            size_t end                 = unit.offset + unit.size;
+            size_t pos                 = find_start_code(data, unit.offset, end);
+            while (pos + HEVC_START_CODE_LEN < end && ((data[pos + HEVC_START_CODE_LEN] >> 1) & 0x3f) >= HEVC_NAL_VPS)
+                pos = find_start_code(data, pos + HEVC_START_CODE_LEN, end);
+            for (; next_param < params.size() && params[next_param].offset < pos; next_param++) {
+                const HevcParameterSet &ps = params[next_param];
+                if (ps.size <= HEVC_START_CODE_LEN + 1 || ps.offset > size || ps.size > size - ps.offset)
+                    continue;
+                const mfxU8 *nal           = data + ps.offset + HEVC_START_CODE_LEN + (data[ps.offset + 2] == 0);
+                size_t nal_size            = data + ps.offset + ps.size - nal;
+                if (ps.nal_type == HEVC_NAL_SPS)
+                    ParseHevcSps(nal, nal_size, sps);
+                else if (ps.nal_type == HEVC_NAL_PPS)
+                    ParseHevcPps(nal, nal_size, pps);
+            }
+            HevcSliceHeader slice = {};
+            size_t nal            = pos + HEVC_START_CODE_LEN;
+            if (pos + HEVC_START_CODE_LEN >= end || !ParseHevcSliceHeader(data + nal, end - nal, sps, pps, &slice)) {
+                display.clear();
+                return;
+            }
+
+            mfxU8 type     = unit.nal_type;
+            mfxI32 max_lsb = 1 << slice.log2_max_poc_lsb;
+            mfxI32 poc_msb = 0;
+            if (!new_sequence) {
+                mfxI32 prev_lsb = prev_tid0_poc & (max_lsb - 1);
+                mfxI32 prev_msb = prev_tid0_poc - prev_lsb;
+                mfxI32 lsb      = (mfxI32)slice.poc_lsb;
+                if (lsb < prev_lsb && prev_lsb - lsb >= max_lsb / 2)
+                    poc_msb = prev_msb + max_lsb;
+                else if (lsb > prev_lsb && lsb - prev_lsb > max_lsb / 2)
+                    poc_msb = prev_msb - max_lsb;
+                else
+                    poc_msb = prev_msb;
+            }
+            mfxI32 poc = poc_msb + (mfxI32)slice.poc_lsb;
+
+            // RASL_N/RASL_R belong to the previous IRAP, not decodable when that IRAP started the sequence
+            bool rasl = type == 8 || type == 9;
+            bool radl = type == 6 || type == 7;
+            if (unit.flags & HEVC_AU_IRAP)
+                skip_rasl = new_sequence;
+            if (unit.temporal_id == 0 && !rasl && !radl && (unit.flags & HEVC_AU_REFERENCE))
+                prev_tid0_poc = poc;
+            if (slice.pic_output && !(rasl && skip_rasl))
+                sequence.push_back(std::make_pair(poc, i));
+        }
+    }
+
+    // Closest IDR at or before access unit au, decoding from an arbitrary frame must start there
+    mfxU32 IdrAtOrBefore(mfxU32 au) const {
+        std::vector<mfxU32>::const_iterator it = std::upper_bound(idr.begin(), idr.end(), au);
+        return (it == idr.begin()) ? 0 : *(it - 1);
+    }
+
+    // Split data into access units following the H.265 7.4.2.4.4 rules for the first NAL unit of an AU
+    void Build(const mfxU8 *data, size_t size) {
+        static const FindStartCodeFn find_start_code = GetFindStartCode();
+        units.clear();
+        params.clear();
+
+        HevcAccessUnit au = {};
+        bool au_open      = false;
+        bool au_has_vcl   = false;
+        size_t pos        = find_start_code(data, 0, size);
+        while (pos < size) {
+            size_t nal  = pos + HEVC_START_CODE_LEN;
+            size_t next = find_start_code(data, nal, size);
+            if (nal + 2 > size)
+                break;
+
+            // a leading zero_byte belongs to the 4-byte start code of this NAL unit
+            size_t start   = (pos > 0 && data[pos - 1] == 0) ? pos - 1 : pos;
+            size_t end     = (next < size && data[next - 1] == 0) ? next - 1 : next;
+            mfxU8 type     = (data[nal] >> 1) & 0x3f;
+            mfxU8 tid      = (data[nal + 1] & 0x7) ? (data[nal + 1] & 0x7) - 1 : 0;
+            bool vcl       = type < HEVC_NAL_VPS;
+            bool new_pic   = vcl && nal + 2 < size && (data[nal + 2] & 0x80);
+            bool starts_au = new_pic || (type >= HEVC_NAL_VPS && type <= HEVC_NAL_AUD) ||
+                             type == HEVC_NAL_PREFIX_SEI || (type >= 41 && type <= 44) ||
+                             (type >= 48 && type <= 55);
+
+            if (starts_au && au_has_vcl) {
+                au.size = (mfxU32)(start - au.offset);
+                units.push_back(au);
+                au_open    = false;
+                au_has_vcl = false;
+            }
+            if (!au_open) {
+                au        = {};
+                au.offset = start;
+                au_open   = true;
+            }
+            if (type >= HEVC_NAL_VPS && type <= HEVC_NAL_PPS) {
+                HevcParameterSet ps = {};
+                ps.offset           = start;
+                ps.size             = (mfxU32)(end - start);
+                ps.nal_type         = type;
+                params.push_back(ps);
+                au.flags |= HEVC_AU_PARAMS;
+            }
+            if (vcl && !au_has_vcl) {
+                au_has_vcl     = true;
+                au.nal_type    = type;
+                au.temporal_id = tid;
+                if (type >= HEVC_NAL_BLA_W_LP && type <= HEVC_NAL_RSV_IRAP_23)
+                    au.flags |= HEVC_AU_IRAP;
+                if (type == HEVC_NAL_IDR_W_RADL || type == HEVC_NAL_IDR_N_LP)
+                    au.flags |= HEVC_AU_IDR;
+                // even types up to RSV_VCL_N14 are sub-layer non-reference pictures
+                if (type > HEVC_NAL_RSV_VCL_N14 || (type & 1))
+                    au.flags |= HEVC_AU_REFERENCE;
+            }
+            pos = next;
+        }
+        if (au_open && au_has_vcl) {
+            au.size = (mfxU32)(size - au.offset);
+            units.push_back(au);
+        }
+        else if (au_open && !units.empty()) {
+            // trailing non-VCL NAL units (end of sequence, filler) stay with the last picture
+            units.back().size = (mfxU32)(size - units.back().offset);
+        }
+        UpdateIdr();
+    }
+
+    bool Load(const std::string &path, mfxU64 file_size, mfxI64 file_mtime_ns) {
+        FILE *f = fopen(path.c_str(), "rb");
+        if (!f)
+            return false;
+
+        HevcIndexHeader header = {};
+        bool ok = fread(&header, sizeof(header), 1, f) == 1 &&
+                  !memcmp(header.magic, HEVC_INDEX_MAGIC, sizeof(header.magic)) &&
+                  header.file_size == file_size && header.file_mtime_ns == file_mtime_ns;
+        // the counts must account for exactly the rest of the index file
+        if (ok) {
+            long start = ftell(f);
+            long end   = fseek(f, 0, SEEK_END) == 0 ? ftell(f) : -1;
+            mfxU64 expected =
+                (mfxU64)header.num_units * sizeof(HevcAccessUnit) + (mfxU64)header.num_params * sizeof(HevcParameterSet);
+            ok = start >= 0 && end >= start && (mfxU64)(end - start) == expected && fseek(f, start, SEEK_SET) == 0;
+        }
+        if (ok) {
+            units.resize(header.num_units);
+            params.resize(header.num_params);
+            ok = fread(units.data(), sizeof(HevcAccessUnit), units.size(), f) == units.size() &&
+                 fread(params.data(), sizeof(HevcParameterSet), params.size(), f) == params.size() &&
+                 Fits(file_size);
+        }
+        fclose(f);
+        if (!ok) {
+            units.clear();
+            params.clear();
+        }
+        UpdateIdr();
+        return ok;
+    }
+
+    // Written to a temporary file first so concurrent runs never see a partial index
+    bool Save(const std::string &path, mfxU64 file_size, mfxI64 file_mtime_ns) const {
+        std::string tmp_path = path + ".tmp" + std::to_string(getpid());
+        FILE *f              = fopen(tmp_path.c_str(), "wb");
+        if (!f)
+            return false;
+
+        HevcIndexHeader header = {};
+        memcpy(header.magic, HEVC_INDEX_MAGIC, sizeof(header.magic));
+        header.file_size     = file_size;
+        header.file_mtime_ns = file_mtime_ns;
+        header.num_units     = (mfxU32)units.size();
+        header.num_params    = (mfxU32)params.size();
+        bool ok              = fwrite(&header, sizeof(header), 1, f) == 1 &&
+                  fwrite(units.data(), sizeof(HevcAccessUnit), units.size(), f) == units.size() &&
+                  fwrite(params.data(), sizeof(HevcParameterSet), params.size(), f) == params.size();
+        ok = (fclose(f) == 0) && ok;
+        if (ok)
+            ok = rename(tmp_path.c_str(), path.c_str()) == 0;
+        if (!ok)
+            unlink(tmp_path.c_str());
+        return ok;
+    }
+
+   private:
+    // Units and parameter sets in increasing order within the file, a stale or damaged index
+    // must not point the decoder outside the mapping
+    bool Fits(mfxU64 file_size) const {
+        mfxU64 end = 0;
+        for (const HevcAccessUnit &au : units) {
+            if (au.offset < end || au.offset > file_size || au.size == 0 || au.size > file_size - au.offset)
+                return false;
+            end = au.offset + au.size;
+        }
+        end = 0;
+        for (const HevcParameterSet &ps : params) {
+            if (ps.offset < end || ps.offset > file_size || ps.size == 0 || ps.size > file_size - ps.offset)
+                return false;
+            end = ps.offset + ps.size;
+        }
+        return true;
+    }
+
+    void UpdateIdr() {
+        idr.clear();
+        max_temporal_id = 0;
+        for (mfxU32 i = 0; i < units.size(); i++) {
+            if (units[i].flags & HEVC_AU_IDR)
+                idr.push_back(i);
+            max_temporal_id = std::max(max_temporal_id, units[i].temporal_id);
+        }
+    }
+};
+
+// Load <path>.idx when it matches the file, otherwise scan the mapping and store the index.
+// Returns an empty pointer when the file has no HEVC pictures.
+std::shared_ptr<const HevcIndex> LoadHevcIndex(const char *path, const FileMapping &mapping) {
+    struct stat st = {};
+    if (stat(path, &st) != 0)
+        return std::shared_ptr<const HevcIndex>();
+    mfxI64 mtime_ns = (mfxI64)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+
+    std::shared_ptr<HevcIndex> index(new HevcIndex);
+    std::string index_path = std::string(path) + HEVC_INDEX_SUFFIX;
+    bool cached            = index->Load(index_path, mapping.size, mtime_ns);
+    if (!cached) {
+        index->Build(mapping.base, mapping.size);
+        if (!index->Save(index_path, mapping.size, mtime_ns))
+            printf("Not able to write index %s\n", index_path.c_str());
+    }
+    if (index->units.empty())
+        return std::shared_ptr<const HevcIndex>();
+    index->UpdateDisplayOrder(mapping.base, mapping.size);
+
+    printf("Indexed %s: %zu frames, %zu IDR, %zu parameter sets%s\n",
+           path,
+           index->FrameCount(),
+           index->idr.size(),
+           index->params.size(),
+           cached ? " (cached)" : "");
+    return index;
+}
+
+// Feeds the decoder exactly one access unit at a time with MFX_BITSTREAM_COMPLETE_FRAME,
+// so the decoder never has to look for the next start code to finish a picture.
+// [first, end) limits the source to a segment of the file; end = 0 reads to the end of the file.
+// mode drops the access units not needed for the pictures to output. bs.TimeStamp carries the
+// output position of every picture, the decoder hands it on to the decoded surface.
+class AccessUnitBitstreamSource : public BitstreamSource {
+   public:
+    AccessUnitBitstreamSource(std::shared_ptr<FileMapping> mapping,
+                              std::shared_ptr<const HevcIndex> index,
+                              mfxU32 first        = 0,
+                              mfxU32 end          = 0,
+                              HevcDecodeMode mode = HEVC_DECODE_ALL)
+        : _mapping(mapping),
+          _index(index),
+          _end(end ? end : (mfxU32)index->units.size()),
+          _mode(mode) {
+        Seek(first);
+    }
+
+    bool HasFrameIndex() const override {
+        return true;
+    }
+
+    mfxStatus Feed(mfxBitstream &bs) override {
+        // move on only once the decoder took the whole access unit
+        if (_presented && bs.DataLength == 0) {
+            Advance();
+            _presented = false;
+        }
+        if (_presented)
+            return MFX_ERR_NONE;
+
+        if (_cur >= _end) {
+            bs.DataOffset = 0;
+            bs.DataLength = 0;
+            return MFX_ERR_MORE_DATA;
+        }
+
+        const HevcAccessUnit &au = _index->units[_cur];
+        if (_cur == _prefixedUnit && !_prefixed.empty()) {
+            bs.Data       = _prefixed.data();
+            bs.DataLength = (mfxU32)_prefixed.size();
+        }
+        else {
+            bs.Data       = _mapping->base + au.offset;
+            bs.DataLength = au.size;
+        }
+        bs.DataOffset = 0;
+        bs.MaxLength  = bs.DataLength;
+        bs.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
+        bs.TimeStamp  = _index->DisplayIndex(_cur);
+        _presented    = true;
+        if (_prefetch)
+            _prefetch->require(au.offset, au.offset + au.size);
+        return MFX_ERR_NONE;
+    }
+
+    void SetPrefetcher(Prefetcher *prefetcher) override {
+        size_t start = _cur < _index->units.size() ? (size_t)_index->units[_cur].offset : 0;
+        _prefetch    = prefetcher->track(_mapping->base, _mapping->size, _mapping, start);
+    }
+
+    // Continue from access unit au, which should be an IDR (see HevcIndex::IdrAtOrBefore).
+    // The decoder has to be reset before decoding from the new position.
+    void Seek(mfxU32 au) {
+        _prefixedUnit = au;
+        _cur          = au;
+        _presented    = false;
+        _prefixed.clear();
+        if (au >= _index->units.size() || (_index->units[au].flags & HEVC_AU_PARAMS))
+            return;
+
+        // The access unit does not carry its own parameter sets: the last VPS, SPS and PPS
+        // seen before it are copied in front of it, once
+        const HevcAccessUnit &unit = _index->units[au];
+        const HevcParameterSet *active[3] = {};
+        for (const HevcParameterSet &ps : _index->params) {
+            if (ps.offset >= unit.offset)
+                break;
+            active[ps.nal_type - HEVC_NAL_VPS] = &ps;
+        }
+        for (const HevcParameterSet *ps : active) {
+            if (ps)
+                _prefixed.insert(_prefixed.end(),
+                                 _mapping->base + ps->offset,
+                                 _mapping->base + ps->offset + ps->size);
+        }
+        _prefixed.insert(_prefixed.end(), _mapping->base + unit.offset, _mapping->base + unit.offset + unit.size);
+    }
+
+   private:
+    // Next access unit to decode in _mode. Parameter sets carried by skipped access units
+    // are copied in front of it, later pictures may refer to them.
+    void Advance() {
+        mfxU32 skipped = _cur + 1;
+        mfxU32 next    = skipped;
+        bool params    = false;
+        while (next < _end && !_index->IsDecoded(next, _mode))
+            params |= (_index->units[next++].flags & HEVC_AU_PARAMS) != 0;
+        _cur = next;
+        if (!params || next >= _end)
+            return;
+
+        const HevcAccessUnit &unit = _index->units[next];
+        mfxU64 from                = _index->units[skipped].offset;
+        _prefixed.clear();
+        _prefixedUnit = next;
+        for (const HevcParameterSet &ps : _index->params) {
+            if (ps.offset >= from && ps.offset < unit.offset)
+                _prefixed.insert(_prefixed.end(),
+                                 _mapping->base + ps.offset,
+                                 _mapping->base + ps.offset + ps.size);
+        }
+        _prefixed.insert(_prefixed.end(), _mapping->base + unit.offset, _mapping->base + unit.offset + unit.size);
+    }
+
+    std::shared_ptr<FileMapping> _mapping;
+    std::shared_ptr<const HevcIndex> _index;
+    mfxU32 _cur;
+    mfxU32 _end;
+    HevcDecodeMode _mode;
+    bool _presented;
+    mfxU32 _prefixedUnit;          // access unit fed from _prefixed instead of the mapping
+    std::vector<mfxU8> _prefixed;  // parameter sets + access unit
+};
+
+// Split the access units of index into at most count segments of similar length,
+// each one starting at an IDR so it can be decoded independently (closed GOP).
+// Returns the first access unit of every segment.
+std::vector<mfxU32> SplitAtIdr(const HevcIndex &index, mfxU32 count) {
+    std::vector<mfxU32> starts;
+    if (index.units.empty())
+        return starts;
+
+    starts.push_back(0);
+    for (mfxU32 i = 1; i < count; i++) {
+        mfxU32 target = (mfxU32)((mfxU64)index.units.size() * i / count);
+        std::vector<mfxU32>::const_iterator it = std::lower_bound(index.idr.begin(), index.idr.end(), target);
+        if (it != index.idr.end() && *it > starts.back())
+            starts.push_back(*it);
+    }
+    return starts;
+}
+
+// Open path for whole-frame decoding; falls back to a plain windowed source
+// when the input cannot be mapped or indexed. index is left empty in that case.
+std::unique_ptr<BitstreamSource> OpenIndexedBitstreamSource(const char *path,
+                                                            mfxU32 window,
+                                                            std::shared_ptr<const HevcIndex> *index,
+                                                            HevcDecodeMode mode = HEVC_DECODE_ALL) {
+    std::shared_ptr<FileMapping> mapping = MapFile(path);
+    if (mapping)
+        *index = LoadHevcIndex(path, *mapping);
+    if (!mapping || !*index)
+        return OpenBitstreamSource(path, window);
+
+    return std::unique_ptr<BitstreamSource>(new AccessUnitBitstreamSource(mapping, *index, 0, 0, mode));
+}
+
+#endif //EXAMPLES_HEVC_INDEX_H_
@@ -0,0 +1,402 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Per-stage latency histograms, per-stream frame rates and gauges of the
+/// decode -> infer pipeline, exported periodically as Prometheus text or JSON
+///
+/// @file
+
+#ifndef EXAMPLES_METRICS_H_
+#define EXAMPLES_METRICS_H_
+
+#include <stdio.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "utils/trace.h"
+
+// Log-linear buckets: values below 2^METRICS_SUB_BITS are exact, above that every power of two
+// is split into 2^METRICS_SUB_BITS buckets (about 3% relative error). Latencies are clamped at 2^40 ns.
+#define METRICS_SUB_BITS    5
+#define METRICS_MAX_BITS    40
+#define METRICS_BUCKETS     ((METRICS_MAX_BITS - METRICS_SUB_BITS + 1) << METRICS_SUB_BITS)
+#define METRICS_MAX_STREAMS 256  // streams counted at once, a stream takes the slot of its id modulo this
+
+enum MetricStage {
+    METRIC_READ,        // BitstreamSource::Feed
+    METRIC_DECODE,      // DecodeFrameAsync
+    METRIC_VPP,         // VPP ProcessFrameAsync
+    METRIC_SYNC,        // Synchronize of the VPP output
+    METRIC_QUEUE_WAIT,  // decoded frame waiting for its batch
+    METRIC_TENSOR,      // remote tensor creation
+    METRIC_INFER,       // start_async until the request completed
+    METRIC_POSTPROCESS, // result printing and surface release
+    METRIC_FRAME_AGE,   // decoded frame handed to inference until its result was done
+    METRIC_STAGE_COUNT
+};
+
+static const char *const kMetricStageNames[METRIC_STAGE_COUNT] =
+    {"read", "decode", "vpp", "sync", "queue_wait", "tensor", "infer", "postprocess", "frame_age"};
+
+// Histogram written by a single thread, read concurrently by the exporter
+class LatencyHistogram {
+   public:
+    LatencyHistogram() {
+        for (auto &count : _counts)
+            count.store(0, std::memory_order_relaxed);
+    }
+
+    void record(unsigned long long ns) {
+        // single writer: plain load/store instead of read-modify-write
+        std::atomic<unsigned long long> &count = _counts[BucketOf(ns)];
+        count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _sum.store(_sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+        if (ns > _max.load(std::memory_order_relaxed))
+            _max.store(ns, std::memory_order_relaxed);
+    }
+
+    static size_t BucketOf(unsigned long long ns) {
+        if (ns >> METRICS_MAX_BITS)
+            ns = (1ULL << METRICS_MAX_BITS) - 1;
+        if (ns < (1ULL << METRICS_SUB_BITS))
+            return (size_t)ns;
+        int shift = 63 - __builtin_clzll(ns) - METRICS_SUB_BITS;
+        return ((size_t)(shift + 1) << METRICS_SUB_BITS) + (size_t)((ns >> shift) & ((1 << METRICS_SUB_BITS) - 1));
+    }
+
+    // middle of the values falling into bucket
+    static double ValueOf(size_t bucket) {
+        if (bucket < (1u << METRICS_SUB_BITS))
+            return (double)bucket;
+        int shift            = (int)(bucket >> METRICS_SUB_BITS) - 1;
+        unsigned long long v = ((1ULL << METRICS_SUB_BITS) + (bucket & ((1 << METRICS_SUB_BITS) - 1))) << shift;
+        return v + ((1ULL << shift) - 1) / 2.0;
+    }
+
+    std::atomic<unsigned long long> _counts[METRICS_BUCKETS];
+    std::atomic<unsigned long long> _sum{0};
+    std::atomic<unsigned long long> _max{0};
+};
+
+// Sum of the per-thread histograms of a stage at export time
+struct LatencySummary {
+    unsigned long long count = 0;
+    double sum_ns            = 0;
+    double max_ns            = 0;
+    std::vector<unsigned long long> counts = std::vector<unsigned long long>(METRICS_BUCKETS);
+
+    void add(const LatencyHistogram &histogram) {
+        for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+            unsigned long long n = histogram._counts[i].load(std::memory_order_relaxed);
+            counts[i] += n;
+            count += n;
+        }
+        sum_ns += (double)histogram._sum.load(std::memory_order_relaxed);
+        max_ns = std::max(max_ns, (double)histogram._max.load(std::memory_order_relaxed));
+    }
+
+    double percentile_ns(double p) const {
+        if (count == 0)
+            return 0;
+        unsigned long long rank = (unsigned long long)(p / 100 * count + 0.5);
+        rank                    = std::max(rank, 1ULL);
+        unsigned long long seen = 0;
+        for (size_t i = 0; i < METRICS_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen >= rank)
+                return std::min(LatencyHistogram::ValueOf(i), max_ns);
+        }
+        return max_ns;
+    }
+};
+
+// Peak resident set size of the process so far
+inline double PeakRssMb() {
+    struct rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0; // kilobytes on Linux
+}
+
+// Process wide registry, disabled (and close to free) until Start() is called
+class Metrics {
+   public:
+    static Metrics &Get() {
+        static Metrics metrics;
+        return metrics;
+    }
+
+    bool enabled() const {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    void record(MetricStage stage, std::chrono::steady_clock::duration elapsed) {
+        if (!enabled())
+            return;
+        shard().stages[stage].record(
+            (unsigned long long)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+
+    // one frame of stream_id went through the whole pipeline. Stream ids are never reused, a newer
+    // stream takes over the slot of an older one (attached and detached streams keep being counted);
+    // a frame counted while the slot changes hands may be lost.
+    void count_frame(size_t stream_id) {
+        if (!enabled())
+            return;
+        size_t slot                = stream_id % METRICS_MAX_STREAMS;
+        unsigned long long owner   = _owners[slot].load(std::memory_order_acquire);
+        unsigned long long claimed = stream_id + 1;
+        while (owner < claimed) {
+            if (_owners[slot].compare_exchange_weak(owner, claimed, std::memory_order_acq_rel)) {
+                _frames[slot].store(0, std::memory_order_relaxed);
+                owner = claimed;
+            }
+        }
+        if (owner != claimed) {
+            // more than METRICS_MAX_STREAMS streams at once
+            if (!_overflowWarned.exchange(true))
+                printf("Metrics: stream %zu not counted, more than %d streams\n", stream_id, METRICS_MAX_STREAMS);
+            return;
+        }
+        _frames[slot].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // Sampled by the exporter, the sampled object has to outlive Stop()
+    void add_gauge(const std::string &name, std::function<double()> sample) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _gauges.push_back(std::make_pair(name, sample));
+    }
+
+    // Export every interval: target "-" prints one JSON object per line to stdout,
+    // anything else is a Prometheus text file replaced atomically (node_exporter textfile collector)
+    void Start(const std::string &target, std::chrono::milliseconds interval) {
+        _target   = target;
+        _interval = interval;
+        _start = _last = std::chrono::steady_clock::now();
+        _stopping      = false;
+        _enabled       = true;
+        _exporter      = std::thread([this] {
+            std::unique_lock<std::mutex> lock(_mutex);
+            while (!_stopping) {
+                _wake.wait_for(lock, _interval, [this] { return _stopping; });
+                Export();
+            }
+        });
+    }
+
+    // Write the last numbers and stop the exporter
+    void Stop() {
+        if (!_exporter.joinable())
+            return;
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _wake.notify_all();
+        _exporter.join();
+        _enabled = false;
+    }
+
+   private:
+    struct Shard {
+        LatencyHistogram stages[METRIC_STAGE_COUNT];
+    };
+
+    Metrics() {
+        for (auto &frames : _frames)
+            frames.store(0, std::memory_order_relaxed);
+        for (auto &owner : _owners)
+            owner.store(0, std::memory_order_relaxed);
+    }
+
+    ~Metrics() {
+        Stop();
+    }
+
+    // each thread registers its own histograms once, they stay alive after it exits
+    Shard &shard() {
+        thread_local Shard *local = NULL;
+        if (!local) {
+            std::unique_ptr<Shard> created(new Shard);
+            local = created.get();
+            std::unique_lock<std::mutex> lock(_shardMutex);
+            _shards.push_back(std::move(created));
+        }
+        return *local;
+    }
+
+    // called with _mutex held
+    void Export() {
+        auto now       = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - _last).count();
+        double uptime  = std::chrono::duration<double>(now - _start).count();
+        _last          = now;
+
+        LatencySummary stages[METRIC_STAGE_COUNT];
+        {
+            std::unique_lock<std::mutex> lock(_shardMutex);
+            for (auto &shard : _shards) {
+                for (int s = 0; s < METRIC_STAGE_COUNT; s++)
+                    stages[s].add(shard->stages[s]);
+            }
+        }
+        std::vector<std::pair<size_t, double>> fps;
+        for (size_t i = 0; i < METRICS_MAX_STREAMS; i++) {
+            unsigned long long owner = _owners[i].load(std::memory_order_acquire);
+            if (owner != _lastOwners[i]) {
+                _lastOwners[i] = owner;
+                _lastFrames[i] = 0;
+            }
+            unsigned long long frames = _frames[i].load(std::memory_order_relaxed);
+            if (frames < _lastFrames[i])
+                _lastFrames[i] = 0;
+            if (frames)
+                fps.push_back(std::make_pair(owner - 1, elapsed > 0 ? (frames - _lastFrames[i]) / elapsed : 0));
+            _lastFrames[i] = frames;
+        }
+
+        std::string out;
+        char line[512];
+        if (_target == "-") {
+            snprintf(line, sizeof(line), "{\"uptime_s\": %.3f, \"stages\": {", uptime);
+            out += line;
+            for (int s = 0; s < METRIC_STAGE_COUNT; s++) {
+                const LatencySummary &l = stages[s];
+                snprintf(line,
+                         sizeof(line),
+                         "%s\"%s\": {\"count\": %llu, \"mean_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f, "
+                         "\"p99_ms\": %.3f, \"max_ms\": %.3f}",
+                         s ? ", " : "",
+                         kMetricStageNames[s],
+                         l.count,
+                         l.count ? l.sum_ns / l.count / 1e6 : 0,
+                         l.percentile_ns(50) / 1e6,
+                         l.percentile_ns(90) / 1e6,
+                         l.percentile_ns(99) / 1e6,
+                         l.max_ns / 1e6);
+                out += line;
+            }
+            out += "}, \"stream_fps\": {";
+            for (size_t i = 0; i < fps.size(); i++) {
+                snprintf(line, sizeof(line), "%s\"%zu\": %.2f", i ? ", " : "", fps[i].first, fps[i].second);
+                out += line;
+            }
+            out += "}, \"gauges\": {";
+            for (size_t i = 0; i < _gauges.size(); i++) {
+                snprintf(line, sizeof(line), "%s\"%s\": %g", i ? ", " : "", _gauges[i].first.c_str(), _gauges[i].second());
+                out += line;
+            }
+            out += "}}\n";
+            fputs(out.c_str(), stdout);
+            fflush(stdout);
+            return;
+        }
+
+        out += "# TYPE vpl_stage_latency_seconds summary\n";
+        for (int s = 0; s < METRIC_STAGE_COUNT; s++) {
+            const LatencySummary &l = stages[s];
+            const double quantiles[] = {0.5, 0.9, 0.99};
+            for (double q : quantiles) {
+                snprintf(line,
+                         sizeof(line),
+                         "vpl_stage_latency_seconds{stage=\"%s\",quantile=\"%g\"} %.9f\n",
+                         kMetricStageNames[s],
+                         q,
+                         l.percentile_ns(q * 100) / 1e9);
+                out += line;
+            }
+            snprintf(line,
+                     sizeof(line),
+                     "vpl_stage_latency_seconds_sum{stage=\"%s\"} %.9f\nvpl_stage_latency_seconds_count{stage=\"%s\"} %llu\n",
+                     kMetricStageNames[s],
+                     l.sum_ns / 1e9,
+                     kMetricStageNames[s],
+                     l.count);
+            out += line;
+        }
+        out += "# TYPE vpl_stream_fps gauge\n";
+        for (auto &stream : fps) {
+            snprintf(line, sizeof(line), "vpl_stream_fps{stream=\"%zu\"} %.2f\n", stream.first, stream.second);
+            out += line;
+        }
+        for (auto &gauge : _gauges) {
+            snprintf(line, sizeof(line), "# TYPE vpl_%s gauge\nvpl_%s %g\n", gauge.first.c_str(), gauge.first.c_str(), gauge.second());
+            out += line;
+        }
+
+        std::string tmp_path = _target + ".tmp" + std::to_string(getpid());
+        FILE *f              = fopen(tmp_path.c_str(), "w");
+        if (!f) {
+            printf("Not able to write metrics to %s\n", tmp_path.c_str());
+            return;
+        }
+        bool ok = fwrite(out.data(), 1, out.size(), f) == out.size();
+        ok      = (fclose(f) == 0) && ok;
+        if (!ok || rename(tmp_path.c_str(), _target.c_str()) != 0)
+            unlink(tmp_path.c_str());
+    }
+
+    std::atomic<bool> _enabled{false};
+    std::mutex _shardMutex;
+    std::vector<std::unique_ptr<Shard>> _shards;
+    std::atomic<unsigned long long> _frames[METRICS_MAX_STREAMS];
+    std::atomic<unsigned long long> _owners[METRICS_MAX_STREAMS];  // stream id + 1 counted in each slot, 0 for none
+    unsigned long long _lastFrames[METRICS_MAX_STREAMS] = {};
+    unsigned long long _lastOwners[METRICS_MAX_STREAMS] = {};
+    std::atomic<bool> _overflowWarned{false};
+
+    std::mutex _mutex; // exporter state and gauges
+    std::condition_variable _wake;
+    std::vector<std::pair<std::string, std::function<double()>>> _gauges;
+    std::string _target;
+    std::chrono::milliseconds _interval{1000};
+    std::chrono::steady_clock::time_point _start;
+    std::chrono::steady_clock::time_point _last;
+    std::thread _exporter;
+    bool _stopping = false;
+};
+
+// Times its own scope as one stage and traces it when tracing is on,
+// does not read the clock while both are disabled
+class MetricScope {
+   public:
+    explicit MetricScope(MetricStage stage, long long frame = -1)
+        : _stage(stage),
+          _frame(frame),
+          _enabled(Metrics::Get().enabled()),
+          _traced(Trace::Get().enabled()) {
+        if (_enabled || _traced)
+            _begin = std::chrono::steady_clock::now();
+    }
+
+    ~MetricScope() {
+        if (!_enabled && !_traced)
+            return;
+        auto end = std::chrono::steady_clock::now();
+        if (_enabled)
+            Metrics::Get().record(_stage, end - _begin);
+        if (_traced)
+            Trace::Get().record(kMetricStageNames[_stage], _begin, end, _frame);
+    }
+
+   private:
+    MetricStage _stage;
+    long long _frame;
+    bool _enabled;
+    bool _traced;
+    std::chrono::steady_clock::time_point _begin;
+};
+
+#endif //EXAMPLES_METRICS_H_
@@ -0,0 +1,86 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Compiled model blobs exported next to a run and imported by the next one,
+/// so startup skips the kernel compilation
+///
+/// @file
+
+#ifndef EXAMPLES_MODEL_CACHE_H_
+#define EXAMPLES_MODEL_CACHE_H_
+
+#include <stdio.h>
+#include <fstream>
+#include <string>
+#include <openvino/openvino.hpp>
+
+#define MODEL_HASH_SEED 14695981039346656037ull
+
+// 64-bit FNV-1a, continues from hash
+inline unsigned long long HashBytes(const char *data, size_t size, unsigned long long hash = MODEL_HASH_SEED) {
+    for (size_t i = 0; i < size; i++) {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Hash of a whole file, false if it cannot be read
+inline bool HashFile(const std::string &path, unsigned long long *hash) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return false;
+    char chunk[1 << 16];
+    while (file) {
+        file.read(chunk, sizeof(chunk));
+        *hash = HashBytes(chunk, (size_t)file.gcount(), *hash);
+    }
+    return true;
+}
+
+// Blob path of model_xml (and its weights) compiled with config, a text naming everything that changes
+// the compiled model: device, batch size, streams, preprocessing. Empty if the model cannot be read.
+inline std::string CompiledBlobPath(const std::string &dir, const std::string &model_xml, const std::string &config) {
+    unsigned long long hash = HashBytes(config.data(), config.size());
+    if (!HashFile(model_xml, &hash))
+        return std::string();
+    std::string weights = model_xml.substr(0, model_xml.rfind('.')) + ".bin";
+    HashFile(weights, &hash);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.blob", hash);
+    return dir + "/" + name;
+}
+
+// Import the blob at path, or compile and export it there for the next run.
+// An empty path only compiles, a blob that does not import (e.g. other driver) is replaced.
+template <typename Compile, typename Import>
+ov::CompiledModel CompileOrImport(const std::string &path, Compile compile, Import import_blob, bool *imported) {
+    *imported = false;
+    if (!path.empty()) {
+        std::ifstream blob(path, std::ios::binary);
+        if (blob) {
+            try {
+                ov::CompiledModel compiled_model = import_blob(blob);
+                *imported                        = true;
+                return compiled_model;
+            } catch (const std::exception &e) {
+                printf("Not able to import %s, compiling: %s\n", path.c_str(), e.what());
+            }
+        }
+    }
+    ov::CompiledModel compiled_model = compile();
+    if (!path.empty()) {
+        std::ofstream blob(path, std::ios::binary);
+        if (blob)
+            compiled_model.export_model(blob);
+        if (!blob)
+            printf("Not able to export %s\n", path.c_str());
+    }
+    return compiled_model;
+}
+
+#endif //EXAMPLES_MODEL_CACHE_H_
@@ -0,0 +1,140 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Read-ahead of memory mapped inputs on a shared I/O thread pool,
+/// so storage latency is paid off the decode threads
+///
+/// @file
+
+#ifndef EXAMPLES_PREFETCH_H_
+#define EXAMPLES_PREFETCH_H_
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include "utils/thread_pool.h"
+
+#define PREFETCH_CHUNK_SIZE (1 << 20)
+
+// Read-ahead state of one input. The decode thread asks for a byte range with
+// require(), an I/O thread faults the pages in ahead of it.
+class PrefetchCursor : public std::enable_shared_from_this<PrefetchCursor> {
+   public:
+    // owner keeps the mapping alive while I/O tasks still reference it,
+    // start is the first byte the source reads (e.g. a segment in the middle of the file)
+    PrefetchCursor(ThreadPool* pool,
+                   const unsigned char* base,
+                   size_t size,
+                   size_t depth,
+                   std::shared_ptr<void> owner,
+                   size_t start = 0)
+        : _pool(pool),
+          _base(base),
+          _size(size),
+          _depth(depth),
+          _owner(owner),
+          _ready(std::min(start, size)),
+          _target(std::min(start, size)) {}
+
+    // Make [pos, end) resident, waiting for the I/O thread if it is not there yet,
+    // and schedule reading up to depth bytes past pos
+    void require(size_t pos, size_t end) {
+        // bytes before pos are not waited for: the source skipped them (seek, segment start, skipped pictures)
+        Raise(_ready, std::min(pos, _size));
+        Raise(_target, std::min(_size, std::max(end, pos + _depth)));
+        if (!_inflight.exchange(true)) {
+            std::shared_ptr<PrefetchCursor> self = shared_from_this();
+            _pool->submit([self] { self->pump(); });
+        }
+
+        end = std::min(end, _size);
+        if (_ready.load() >= end)
+            return;
+
+        auto t1 = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(_mutex);
+        _condition.wait(lock, [&] { return _ready.load() >= end; });
+        _stallNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - t1).count();
+    }
+
+    // total time the decode thread waited for data
+    unsigned long long stall_ns() const {
+        return _stallNs;
+    }
+
+   private:
+    static void Raise(std::atomic<size_t>& value, size_t to) {
+        size_t current = value.load();
+        while (current < to && !value.compare_exchange_weak(current, to)) {
+        }
+    }
+
+    void pump() {
+        const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+        for (;;) {
+            size_t ready = _ready.load();
+            size_t target = _target.load();
+            if (ready >= target) {
+                _inflight.store(false);
+                // the decode thread may have raised the target after the check above
+                if (_ready.load() >= _target.load() || _inflight.exchange(true))
+                    return;
+                continue;
+            }
+
+            size_t end = std::min(target, ready + PREFETCH_CHUNK_SIZE);
+            size_t first = ready / page * page;
+            madvise((void*)(_base + first), end - first, MADV_WILLNEED);
+            // touching one byte per page faults the whole chunk in on this thread
+            unsigned int sum = 0;
+            for (size_t p = first; p < end; p += page)
+                sum += *(volatile const unsigned char*)(_base + p);
+            (void)sum;
+
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                Raise(_ready, end);
+            }
+            _condition.notify_all();
+        }
+    }
+
+    ThreadPool* _pool;
+    const unsigned char* _base;
+    size_t _size;
+    size_t _depth;
+    std::shared_ptr<void> _owner;
+    std::atomic<size_t> _ready{0};
+    std::atomic<size_t> _target{0};
+    std::atomic<bool> _inflight{false};
+    unsigned long long _stallNs = 0;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+};
+
+// I/O threads shared by all inputs, depth is the number of bytes kept ready ahead of each decoder
+class Prefetcher {
+   public:
+    Prefetcher(size_t threads, size_t depth) : _pool(threads), _depth(depth) {}
+
+    // start is the first byte the source reads
+    std::shared_ptr<PrefetchCursor> track(const unsigned char* base,
+                                          size_t size,
+                                          std::shared_ptr<void> owner,
+                                          size_t start = 0) {
+        return std::make_shared<PrefetchCursor>(&_pool, base, size, _depth, owner, start);
+    }
+
+   private:
+    ThreadPool _pool;
+    size_t _depth;
+};
+
+#endif //EXAMPLES_PREFETCH_H_
@@ -0,0 +1,81 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Remote NV12 tensors kept per VA surface, so the decoder's surface pool
+/// is wrapped once instead of on every frame
+///
+/// @file
+
+#ifndef EXAMPLES_REMOTE_TENSOR_CACHE_H_
+#define EXAMPLES_REMOTE_TENSOR_CACHE_H_
+
+#include <atomic>
+#include <unordered_map>
+#include <utility>
+#include <openvino/runtime/intel_gpu/ocl/va.hpp>
+#include "utils/util.h"
+
+// Y and UV remote tensors of every VASurfaceID seen so far. The decoder cycles through
+// a small pool of surfaces, so after the first frames every lookup is a hit.
+// Lookups come from one thread, the counters can be read from any.
+class RemoteTensorCache {
+   public:
+    explicit RemoteTensorCache(ov::intel_gpu::ocl::VAContext &context) : _context(context) {}
+
+    // Tensors of a height x width NV12 surface, a different size drops every entry first
+    std::pair<ov::Tensor, ov::Tensor> get(VASurfaceID surface, size_t height, size_t width) {
+        if (height != _height || width != _width) {
+            if (!_tensors.empty())
+                invalidate();
+            _height = height;
+            _width  = width;
+        }
+        auto it = _tensors.find(surface);
+        if (it != _tensors.end()) {
+            _hits.fetch_add(1, std::memory_order_relaxed);
+            return it->second;
+        }
+        _misses.fetch_add(1, std::memory_order_relaxed);
+        auto nv12 = _context.create_tensor_nv12(height, width, surface);
+        std::pair<ov::Tensor, ov::Tensor> tensors(nv12.first, nv12.second);
+        _tensors[surface] = tensors;
+        return tensors;
+    }
+
+    // Drop every entry, needed once the decoder or VPP was reset: its new pool may reuse surface IDs
+    void invalidate() {
+        _tensors.clear();
+        _invalidations.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t hits() const {
+        return _hits.load(std::memory_order_relaxed);
+    }
+
+    size_t misses() const {
+        return _misses.load(std::memory_order_relaxed);
+    }
+
+    size_t invalidations() const {
+        return _invalidations.load(std::memory_order_relaxed);
+    }
+
+    void print_summary() const {
+        printf("Remote tensor cache: %zu hits, %zu misses, %zu invalidations\n", hits(), misses(), invalidations());
+    }
+
+   private:
+    ov::intel_gpu::ocl::VAContext &_context;
+    std::unordered_map<VASurfaceID, std::pair<ov::Tensor, ov::Tensor>> _tensors;
+    size_t _height = 0;
+    size_t _width  = 0;
+    std::atomic<size_t> _hits{0};
+    std::atomic<size_t> _misses{0};
+    std::atomic<size_t> _invalidations{0};
+};
+
+#endif //EXAMPLES_REMOTE_TENSOR_CACHE_H_
@@ -0,0 +1,89 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Fixed size thread pool running queued tasks in submission order
+///
+/// @file
+
+#ifndef EXAMPLES_THREAD_POOL_H_
+#define EXAMPLES_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+   public:
+    explicit ThreadPool(size_t threads) {
+        for (size_t i = 0; i < threads; i++)
+            _threads.push_back(std::thread([this] { run(); }));
+    }
+
+    // tasks already queued are still run before the threads exit
+    ~ThreadPool() {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _stopping = true;
+        }
+        _condition.notify_all();
+        for (auto& thread : _threads)
+            thread.join();
+    }
+
+    void submit(std::function<void()> task) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _tasks.push_back(std::move(task));
+        }
+        _condition.notify_one();
+    }
+
+    // blocks until every submitted task has finished
+    void wait_idle() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _idle.wait(lock, [this] { return _tasks.empty() && _active == 0; });
+    }
+
+    size_t size() const {
+        return _threads.size();
+    }
+
+   private:
+    void run() {
+        for (;;) {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [this] { return _stopping || !_tasks.empty(); });
+                if (_tasks.empty())
+                    return;
+                task = std::move(_tasks.front());
+                _tasks.pop_front();
+                _active++;
+            }
+            task();
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                if (--_active == 0 && _tasks.empty())
+                    _idle.notify_all();
+            }
+        }
+    }
+
+    std::vector<std::thread> _threads;
+    std::deque<std::function<void()>> _tasks;
+    std::mutex _mutex;
+    std::condition_variable _condition;
+    std::condition_variable _idle;
+    size_t _active = 0;
+    bool _stopping = false;
+};
+
+#endif //EXAMPLES_THREAD_POOL_H_
@@ -0,0 +1,199 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Per-frame pipeline events recorded into per-thread ring buffers and
+/// written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) at exit
+///
+/// @file
+
+#ifndef EXAMPLES_TRACE_H_
+#define EXAMPLES_TRACE_H_
+
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define TRACE_DEFAULT_EVENTS (1 << 16)
+
+struct TraceEvent {
+    const char *name; // string literal, never copied
+    long long begin_ns;
+    long long end_ns;
+    long long frame; // -1 when the event does not belong to a frame
+    int track;       // -1: the thread that recorded it
+};
+
+// Process wide recorder, disabled until Start() is called.
+// Each thread only writes its own ring; once full the oldest events are overwritten.
+class Trace {
+   public:
+    static Trace &Get() {
+        static Trace trace;
+        return trace;
+    }
+
+    bool enabled() const {
+        return _enabled.load(std::memory_order_relaxed);
+    }
+
+    // events_per_thread is the ring size of every thread
+    void Start(const std::string &path, size_t events_per_thread = TRACE_DEFAULT_EVENTS) {
+        _path     = path;
+        _capacity = events_per_thread ? events_per_thread : TRACE_DEFAULT_EVENTS;
+        _origin   = std::chrono::steady_clock::now();
+        _enabled  = true;
+    }
+
+    // Name the track of the calling thread, the first name given sticks
+    void name_thread(const std::string &name) {
+        if (!enabled())
+            return;
+        Buffer &buffer = local();
+        if (buffer.name.empty()) {
+            std::unique_lock<std::mutex> lock(_mutex);
+            buffer.name = name;
+        }
+    }
+
+    // Extra track for work that is not bound to a thread, e.g. one per infer request
+    int add_track(const std::string &name) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _tracks.push_back(name);
+        return (int)_tracks.size() - 1;
+    }
+
+    void record(const char *name,
+                std::chrono::steady_clock::time_point begin,
+                std::chrono::steady_clock::time_point end,
+                long long frame = -1,
+                int track       = -1) {
+        if (!enabled())
+            return;
+        Buffer &buffer = local();
+        size_t head    = buffer.head.load(std::memory_order_relaxed);
+        TraceEvent &ev = buffer.events[head % buffer.events.size()];
+        ev.name        = name;
+        ev.begin_ns    = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - _origin).count();
+        ev.end_ns      = std::chrono::duration_cast<std::chrono::nanoseconds>(end - _origin).count();
+        ev.frame       = frame;
+        ev.track       = track;
+        buffer.head.store(head + 1, std::memory_order_release);
+    }
+
+    // Write the trace, called from the destructor after every pipeline thread is gone
+    void Dump() {
+        if (!enabled())
+            return;
+        _enabled = false;
+        FILE *f  = fopen(_path.c_str(), "w");
+        if (!f) {
+            printf("Not able to write trace %s\n", _path.c_str());
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        size_t written = 0;
+        fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+        // virtual tracks come after the threads
+        int first_track = (int)_buffers.size();
+        for (size_t t = 0; t < _buffers.size(); t++) {
+            std::string name = _buffers[t]->name.empty() ? "thread " + std::to_string(t) : _buffers[t]->name;
+            fprintf(f,
+                    "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"%s\"}}",
+                    written++ ? ",\n" : "",
+                    t,
+                    name.c_str());
+        }
+        for (size_t t = 0; t < _tracks.size(); t++) {
+            fprintf(f,
+                    "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, \"args\": {\"name\": \"%s\"}}",
+                    written++ ? ",\n" : "",
+                    first_track + t,
+                    _tracks[t].c_str());
+        }
+        for (size_t t = 0; t < _buffers.size(); t++) {
+            const Buffer &buffer = *_buffers[t];
+            size_t head          = buffer.head.load(std::memory_order_acquire);
+            size_t count         = std::min(head, buffer.events.size());
+            for (size_t i = head - count; i < head; i++) {
+                const TraceEvent &ev = buffer.events[i % buffer.events.size()];
+                fprintf(f,
+                        "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f",
+                        written++ ? ",\n" : "",
+                        ev.name,
+                        ev.track >= 0 ? first_track + ev.track : (int)t,
+                        ev.begin_ns / 1e3,
+                        (ev.end_ns - ev.begin_ns) / 1e3);
+                if (ev.frame >= 0)
+                    fprintf(f, ", \"args\": {\"frame\": %lld}", ev.frame);
+                fprintf(f, "}");
+            }
+        }
+        fprintf(f, "\n]}\n");
+        fclose(f);
+        printf("Trace with %zu events written to %s\n", written, _path.c_str());
+    }
+
+   private:
+    struct Buffer {
+        std::vector<TraceEvent> events;
+        std::atomic<size_t> head{0};
+        std::string name;
+    };
+
+    ~Trace() {
+        Dump();
+    }
+
+    Buffer &local() {
+        thread_local Buffer *buffer = NULL;
+        if (!buffer) {
+            std::unique_ptr<Buffer> created(new Buffer);
+            created->events.resize(_capacity);
+            buffer = created.get();
+            std::unique_lock<std::mutex> lock(_mutex);
+            _buffers.push_back(std::move(created));
+        }
+        return *buffer;
+    }
+
+    std::atomic<bool> _enabled{false};
+    std::string _path;
+    size_t _capacity = TRACE_DEFAULT_EVENTS;
+    std::chrono::steady_clock::time_point _origin;
+    std::mutex _mutex;
+    std::vector<std::unique_ptr<Buffer>> _buffers;
+    std::vector<std::string> _tracks;
+};
+
+// Records its own scope as one event
+class TraceScope {
+   public:
+    explicit TraceScope(const char *name, long long frame = -1)
+        : _name(name), _frame(frame), _enabled(Trace::Get().enabled()) {
+        if (_enabled)
+            _begin = std::chrono::steady_clock::now();
+    }
+
+    ~TraceScope() {
+        if (_enabled)
+            Trace::Get().record(_name, _begin, std::chrono::steady_clock::now(), _frame);
+    }
+
+   private:
+    const char *_name;
+    long long _frame;
+    bool _enabled;
+    std::chrono::steady_clock::time_point _begin;
+};
+
+#endif //EXAMPLES_TRACE_H_
@@ -15,6 +15,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sstream>
+#include <string>
+#include <vector>
 
 #ifdef USE_MEDIASDK1
     #include "mfxvideo.h"
@@ -611,4 +614,30 @@ mfxStatus WriteRawFrame_InternalMem(mfxFrameSurface1 *surface, FILE *f) {
 }
 #endif
 
+// Initialize VPP and preallocate count surfaces of its internal output pool, the pool still grows past
+// count on demand. The allocation hints are experimental in API 2.9, without them the pool is only
+// grown on demand.
+mfxStatus InitVPPWithOutputPool(mfxSession session, mfxVideoParam *params, mfxU32 count) {
+#if (MFX_VERSION >= 2009) && defined(ONEVPL_EXPERIMENTAL)
+    mfxExtAllocationHints hints = {};
+    mfxExtBuffer *ext           = &hints.Header;
+    if (count > 0) {
+        hints.Header.BufferId    = MFX_EXTBUFF_ALLOCATION_HINTS;
+        hints.Header.BufferSz    = sizeof(hints);
+        hints.AllocationPolicy   = MFX_ALLOCATION_UNLIMITED;
+        hints.NumberToPreAllocate = count;
+        hints.VPPPoolType        = MFX_VPP_POOL_OUT;
+        params->ExtParam         = &ext;
+        params->NumExtParam      = 1;
+    }
+    mfxStatus sts       = MFXVideoVPP_Init(session, params);
+    params->ExtParam    = NULL;
+    params->NumExtParam = 0;
+    return sts;
+#else
+    (void)count;
+    return MFXVideoVPP_Init(session, params);
+#endif
+}
+
 #endif //EXAMPLES_UTIL_H_
\ No newline at end of file
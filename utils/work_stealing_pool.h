@@ -0,0 +1,209 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Fixed number of worker threads running many cooperative tasks, idle
+/// workers steal tasks queued on busy ones
+///
+/// @file
+
+#ifndef EXAMPLES_WORK_STEALING_POOL_H_
+#define EXAMPLES_WORK_STEALING_POOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "utils/cpu_topology.h"
+#include "utils/trace.h"
+
+#define WORK_STEALING_BACKOFF_US 100
+
+// What a task step returns to its worker
+enum TaskResult {
+    TASK_PROGRESS,  // did some work, run it again
+    TASK_YIELD,     // waiting on the device, run the other tasks first
+    TASK_PARK,      // waiting on something else, whoever ends the wait submits it again
+    TASK_DONE,      // finished, the pool forgets it
+};
+
+// Every worker runs the tasks of its own deque from the front and puts them back at the end,
+// a worker without tasks takes one from the back of another worker's deque. A task is in at most
+// one deque and run by one worker at a time, so its state needs no lock.
+// A worker whose whole deque yielded without progress sleeps WORK_STEALING_BACKOFF_US.
+// Workers may be split into groups (e.g. one per NUMA node): tasks are submitted to a group and
+// only stolen within it.
+template <typename Task>
+class WorkStealingPool {
+   public:
+    // groups[i] is the group of worker i and cpus[i] the CPUs it is pinned to,
+    // empty for a single group of unpinned workers
+    WorkStealingPool(size_t threads,
+                     const std::string& name,
+                     std::function<TaskResult(Task*)> run,
+                     const std::vector<size_t>& groups = std::vector<size_t>(),
+                     const std::vector<CpuList>& cpus = std::vector<CpuList>())
+        : _run(run) {
+        if (threads == 0)
+            threads = 1;
+        for (size_t i = 0; i < threads; i++) {
+            _workers.emplace_back(new Worker);
+            size_t group = i < groups.size() ? groups[i] : 0;
+            if (group >= _groups.size())
+                _groups.resize(group + 1);
+            _workers[i]->group = group;
+            _groups[group].push_back(i);
+        }
+        for (size_t i = 0; i < threads; i++) {
+            CpuList pinned = i < cpus.size() ? cpus[i] : CpuList();
+            _workers[i]->thread = std::thread([this, i, name, pinned] {
+                if (!pinned.empty())
+                    PinCurrentThread(pinned);
+                Trace::Get().name_thread(name + " " + std::to_string(i));
+                work(i);
+            });
+        }
+    }
+
+    // tasks still queued are dropped, their owner ends them first
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(_idleMutex);
+            _stopping = true;
+        }
+        _idle.notify_all();
+        for (auto& worker : _workers)
+            worker->thread.join();
+    }
+
+    // Queue a new or parked task, spread over the workers of its group round robin.
+    // A group without workers falls back to the others.
+    void submit(Task* task, size_t group = 0) {
+        const std::vector<size_t>* members = &_groups[group % _groups.size()];
+        for (size_t i = 0; members->empty() && i < _groups.size(); i++)
+            members = &_groups[i];
+        size_t worker = (*members)[_next.fetch_add(1, std::memory_order_relaxed) % members->size()];
+        push(worker, task);
+    }
+
+    size_t size() const {
+        return _workers.size();
+    }
+
+    // Tasks taken from another worker's deque so far
+    unsigned long long steals() const {
+        return _steals.load(std::memory_order_relaxed);
+    }
+
+   private:
+    struct Worker {
+        std::deque<Task*> tasks;
+        std::mutex mutex;
+        std::thread thread;
+        size_t group = 0;
+    };
+
+    void push(size_t worker, Task* task) {
+        {
+            std::lock_guard<std::mutex> lock(_workers[worker]->mutex);
+            _workers[worker]->tasks.push_back(task);
+        }
+        // the count is raised before an idle worker can check it under _idleMutex
+        _queued.fetch_add(1, std::memory_order_seq_cst);
+        if (_sleeping.load(std::memory_order_seq_cst) > 0) {
+            std::lock_guard<std::mutex> lock(_idleMutex);
+            _idle.notify_one();
+        }
+    }
+
+    Task* pop_local(size_t worker, size_t* left) {
+        std::lock_guard<std::mutex> lock(_workers[worker]->mutex);
+        std::deque<Task*>& tasks = _workers[worker]->tasks;
+        if (tasks.empty())
+            return nullptr;
+        Task* task = tasks.front();
+        tasks.pop_front();
+        *left = tasks.size();
+        _queued.fetch_sub(1, std::memory_order_relaxed);
+        return task;
+    }
+
+    Task* steal(size_t thief) {
+        const std::vector<size_t>& members = _groups[_workers[thief]->group];
+        size_t self = std::find(members.begin(), members.end(), thief) - members.begin();
+        for (size_t i = 1; i < members.size(); i++) {
+            Worker& victim = *_workers[members[(self + i) % members.size()]];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (victim.tasks.empty())
+                continue;
+            Task* task = victim.tasks.back();
+            victim.tasks.pop_back();
+            _queued.fetch_sub(1, std::memory_order_relaxed);
+            _steals.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+        return nullptr;
+    }
+
+    void work(size_t self) {
+        size_t unproductive = 0;  // tasks in a row that yielded
+        for (;;) {
+            size_t left = 0;
+            Task* task = pop_local(self, &left);
+            if (!task)
+                task = steal(self);
+            if (!task) {
+                std::unique_lock<std::mutex> lock(_idleMutex);
+                _sleeping.fetch_add(1, std::memory_order_seq_cst);
+                _idle.wait(lock, [this] { return _stopping || _queued.load(std::memory_order_seq_cst) > 0; });
+                _sleeping.fetch_sub(1, std::memory_order_relaxed);
+                if (_stopping)
+                    return;
+                continue;
+            }
+
+            switch (_run(task)) {
+                case TASK_PROGRESS:
+                    unproductive = 0;
+                    push(self, task);
+                    break;
+                case TASK_YIELD:
+                    push(self, task);
+                    // every task of this worker is waiting on the device
+                    if (++unproductive > left) {
+                        unproductive = 0;
+                        std::this_thread::sleep_for(std::chrono::microseconds(WORK_STEALING_BACKOFF_US));
+                    }
+                    break;
+                case TASK_PARK:
+                case TASK_DONE:
+                    break;
+            }
+            if (_stopping)
+                return;
+        }
+    }
+
+    std::function<TaskResult(Task*)> _run;
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<std::vector<size_t>> _groups;  // workers of every group
+    std::atomic<size_t> _next{0};
+    std::atomic<size_t> _queued{0};  // tasks in all deques
+    std::atomic<int> _sleeping{0};
+    std::atomic<unsigned long long> _steals{0};
+    std::mutex _idleMutex;
+    std::condition_variable _idle;
+    std::atomic<bool> _stopping{false};  // set under _idleMutex, also polled between tasks
+};
+
+#endif //EXAMPLES_WORK_STEALING_POOL_H_
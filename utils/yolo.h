@@ -0,0 +1,353 @@
+//==============================================================================
+// Copyright Intel Corporation
+//
+// SPDX-License-Identifier: MIT
+//==============================================================================
+
+///
+/// Decoding of raw YOLO anchor grids and non-maximum suppression on the host,
+/// kept free of OpenVINO so it can be benchmarked
+///
+/// @file
+
+#ifndef EXAMPLES_YOLO_H_
+#define EXAMPLES_YOLO_H_
+
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "utils/detections.h"
+
+#define YOLO_IOU_THRESHOLD 0.45f
+#define YOLO_BOX_SIZE 5 // tx, ty, tw, th, objectness, then the class scores
+// COCO anchors of YOLOv5 in input pixels, heads of stride 8, 16 and 32
+#define YOLO_DEFAULT_ANCHORS "10,13,16,30,33,23;30,61,62,45,59,119;116,90,156,198,373,326"
+
+// One raw output head: [batch, anchors * (5 + classes), height, width] logits, YOLOv5 style
+// (every value goes through a sigmoid, box sizes are (2 sigmoid)^2 times the anchor)
+struct YoloHead {
+    const float *data;
+    size_t batch;
+    size_t anchors;
+    size_t classes;
+    size_t height, width;      // grid
+    const float *anchorSizes;  // width, height of every anchor in input pixels
+};
+
+struct YoloConfig {
+    std::vector<std::vector<float>> anchors;  // width, height pairs of every head, the finest grid first
+    size_t inputWidth = 0;
+    size_t inputHeight = 0;
+    float confidence = DETECTION_THRESHOLD;  // objectness times class score
+    float iou = YOLO_IOU_THRESHOLD;          // boxes of one class overlapping more are suppressed
+};
+
+// Parse "w,h,w,h,...;w,h,..." with one group per head, false if a group is not made of pairs
+inline bool ParseYoloAnchors(const std::string &text, std::vector<std::vector<float>> *anchors) {
+    anchors->clear();
+    size_t start = 0;
+    while (start <= text.size()) {
+        size_t end = text.find(';', start);
+        if (end == std::string::npos)
+            end = text.size();
+        std::vector<float> head;
+        const char *p = text.c_str() + start;
+        while (p < text.c_str() + end) {
+            char *next = NULL;
+            float value = strtof(p, &next);
+            if (next == p)
+                return false;
+            head.push_back(value);
+            p = next;
+            if (*p == ',')
+                p++;
+        }
+        if (head.empty() || head.size() % 2)
+            return false;
+        anchors->push_back(head);
+        start = end + 1;
+    }
+    return !anchors->empty();
+}
+
+// Buffers of DecodeYolo(), reused by every batch of a thread so the steady state allocates nothing.
+// Candidates of one image are kept as a structure of arrays.
+struct YoloScratch {
+    std::vector<unsigned> cells;
+    std::vector<float> tx, ty, tw, th;  // raw box logits
+    std::vector<float> cx, cy;          // grid cell
+    std::vector<float> aw, ah;          // anchor, relative to the input size
+    std::vector<float> sx, sy;          // cell size, relative to the input size
+    std::vector<float> score;
+    std::vector<int> label;
+    std::vector<float> x1, y1, x2, y2;  // decoded corners, relative to the input size
+    std::vector<unsigned> order;
+    // candidates in score order for the suppression
+    std::vector<float> bx1, by1, bx2, by2, area;
+    std::vector<int> blabel;
+    std::vector<int> suppressed;
+
+    void clear() {
+        tx.clear(), ty.clear(), tw.clear(), th.clear();
+        cx.clear(), cy.clear(), aw.clear(), ah.clear(), sx.clear(), sy.clear();
+        score.clear(), label.clear();
+    }
+};
+
+inline float YoloSigmoid(float x) {
+    return 1.0f / (1.0f + expf(-x));
+}
+
+// Cells of one objectness plane at or above the logit threshold, appended to cells
+inline void FilterYoloPlane(const float *plane, size_t size, float logit, size_t first, std::vector<unsigned> &cells) {
+    for (size_t i = first; i < size; i++)
+        if (plane[i] >= logit)
+            cells.push_back((unsigned)i);
+}
+
+#ifdef DETECTIONS_X86
+// The objectness planes are contiguous, 8 or 16 cells are compared at once and only the
+// bits of the mask are visited; most cells of a grid hold no object
+__attribute__((target("avx2"))) inline void FilterYoloPlaneAvx2(const float *plane, size_t size, float logit,
+                                                                std::vector<unsigned> &cells) {
+    const __m256 limit = _mm256_set1_ps(logit);
+    size_t i           = 0;
+    for (; i + 8 <= size; i += 8)
+        for (unsigned keep = _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(plane + i), limit, _CMP_GE_OQ)); keep;
+             keep &= keep - 1)
+            cells.push_back((unsigned)i + __builtin_ctz(keep));
+    FilterYoloPlane(plane, size, logit, i, cells);
+}
+
+__attribute__((target("avx512f"))) inline void FilterYoloPlaneAvx512(const float *plane, size_t size, float logit,
+                                                                     std::vector<unsigned> &cells) {
+    const __m512 limit = _mm512_set1_ps(logit);
+    size_t i           = 0;
+    for (; i + 16 <= size; i += 16)
+        for (unsigned keep = _mm512_cmp_ps_mask(_mm512_loadu_ps(plane + i), limit, _CMP_GE_OQ); keep; keep &= keep - 1)
+            cells.push_back((unsigned)i + __builtin_ctz(keep));
+    FilterYoloPlane(plane, size, logit, i, cells);
+}
+
+// e^x for 8 lanes: 2^n times a degree 5 polynomial on the remainder, about 2 ulp over the sigmoid's range
+__attribute__((target("avx2,fma"))) inline __m256 YoloExp8(__m256 x) {
+    x          = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.0f)), _mm256_set1_ps(88.0f));
+    __m256 n   = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r   = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r          = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+    __m256 p   = _mm256_set1_ps(1.9875691500e-4f);
+    p          = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p          = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p          = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p          = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p          = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p          = _mm256_fmadd_ps(_mm256_mul_ps(p, r), r, _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+    __m256i e  = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(e));
+}
+
+__attribute__((target("avx2,fma"))) inline __m256 YoloSigmoid8(__m256 x) {
+    const __m256 one = _mm256_set1_ps(1.0f);
+    return _mm256_div_ps(one, _mm256_add_ps(one, YoloExp8(_mm256_sub_ps(_mm256_setzero_ps(), x))));
+}
+
+// Box decoding of 8 candidates per step
+__attribute__((target("avx2,fma"))) inline size_t DecodeYoloBoxesAvx2(YoloScratch &s, size_t count) {
+    const __m256 two = _mm256_set1_ps(2.0f), half = _mm256_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256 x = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_fmsub_ps(two, YoloSigmoid8(_mm256_loadu_ps(&s.tx[i])), half), _mm256_loadu_ps(&s.cx[i])),
+            _mm256_loadu_ps(&s.sx[i]));
+        __m256 y = _mm256_mul_ps(
+            _mm256_add_ps(_mm256_fmsub_ps(two, YoloSigmoid8(_mm256_loadu_ps(&s.ty[i])), half), _mm256_loadu_ps(&s.cy[i])),
+            _mm256_loadu_ps(&s.sy[i]));
+        __m256 w = _mm256_mul_ps(two, YoloSigmoid8(_mm256_loadu_ps(&s.tw[i])));
+        __m256 h = _mm256_mul_ps(two, YoloSigmoid8(_mm256_loadu_ps(&s.th[i])));
+        // half of the box size, (2 sigmoid)^2 anchor / 2
+        w = _mm256_mul_ps(_mm256_mul_ps(w, w), _mm256_mul_ps(_mm256_loadu_ps(&s.aw[i]), half));
+        h = _mm256_mul_ps(_mm256_mul_ps(h, h), _mm256_mul_ps(_mm256_loadu_ps(&s.ah[i]), half));
+        _mm256_storeu_ps(&s.x1[i], _mm256_sub_ps(x, w));
+        _mm256_storeu_ps(&s.y1[i], _mm256_sub_ps(y, h));
+        _mm256_storeu_ps(&s.x2[i], _mm256_add_ps(x, w));
+        _mm256_storeu_ps(&s.y2[i], _mm256_add_ps(y, h));
+    }
+    return i;
+}
+
+// Suppress the candidates after first that overlap box i more than iou and have its class
+__attribute__((target("avx2"))) inline size_t SuppressYoloAvx2(YoloScratch &s, size_t i, size_t first, size_t count, float iou) {
+    const __m256 x1 = _mm256_set1_ps(s.bx1[i]), y1 = _mm256_set1_ps(s.by1[i]);
+    const __m256 x2 = _mm256_set1_ps(s.bx2[i]), y2 = _mm256_set1_ps(s.by2[i]);
+    const __m256 area = _mm256_set1_ps(s.area[i]), limit = _mm256_set1_ps(iou), zero = _mm256_setzero_ps();
+    const __m256i label = _mm256_set1_epi32(s.blabel[i]);
+    size_t j = first;
+    for (; j + 8 <= count; j += 8) {
+        __m256 w = _mm256_max_ps(zero, _mm256_sub_ps(_mm256_min_ps(x2, _mm256_loadu_ps(&s.bx2[j])),
+                                                     _mm256_max_ps(x1, _mm256_loadu_ps(&s.bx1[j]))));
+        __m256 h = _mm256_max_ps(zero, _mm256_sub_ps(_mm256_min_ps(y2, _mm256_loadu_ps(&s.by2[j])),
+                                                     _mm256_max_ps(y1, _mm256_loadu_ps(&s.by1[j]))));
+        __m256 inter = _mm256_mul_ps(w, h);
+        // inter / union > iou without the division
+        __m256 overlap = _mm256_cmp_ps(
+            inter, _mm256_mul_ps(limit, _mm256_sub_ps(_mm256_add_ps(area, _mm256_loadu_ps(&s.area[j])), inter)), _CMP_GT_OQ);
+        __m256i same  = _mm256_cmpeq_epi32(label, _mm256_loadu_si256((const __m256i *)&s.blabel[j]));
+        __m256i flags = _mm256_loadu_si256((const __m256i *)&s.suppressed[j]);
+        _mm256_storeu_si256((__m256i *)&s.suppressed[j],
+                            _mm256_or_si256(flags, _mm256_and_si256(same, _mm256_castps_si256(overlap))));
+    }
+    return j;
+}
+#endif
+
+// Scalar box decoding from candidate first on
+inline void DecodeYoloBoxes(YoloScratch &s, size_t first, size_t count) {
+    for (size_t i = first; i < count; i++) {
+        float x = (2.0f * YoloSigmoid(s.tx[i]) - 0.5f + s.cx[i]) * s.sx[i];
+        float y = (2.0f * YoloSigmoid(s.ty[i]) - 0.5f + s.cy[i]) * s.sy[i];
+        float w = 2.0f * YoloSigmoid(s.tw[i]);
+        float h = 2.0f * YoloSigmoid(s.th[i]);
+        w *= w * s.aw[i] * 0.5f;
+        h *= h * s.ah[i] * 0.5f;
+        s.x1[i] = x - w;
+        s.y1[i] = y - h;
+        s.x2[i] = x + w;
+        s.y2[i] = y + h;
+    }
+}
+
+inline void SuppressYolo(YoloScratch &s, size_t i, size_t first, size_t count, float iou) {
+    for (size_t j = first; j < count; j++) {
+        float w     = std::max(0.0f, std::min(s.bx2[i], s.bx2[j]) - std::max(s.bx1[i], s.bx1[j]));
+        float h     = std::max(0.0f, std::min(s.by2[i], s.by2[j]) - std::max(s.by1[i], s.by1[j]));
+        float inter = w * h;
+        if (s.blabel[i] == s.blabel[j] && inter > iou * (s.area[i] + s.area[j] - inter))
+            s.suppressed[j] = -1;
+    }
+}
+
+// Objectness filter and class score of every head of image b, the survivors land in the scratch arrays
+inline void CollectYoloCandidates(const std::vector<YoloHead> &heads,
+                                  size_t b,
+                                  const YoloConfig &config,
+                                  YoloScratch &s,
+                                  DetectionIsa isa) {
+    // objectness at or above the threshold in logits, the final score can only be lower
+    float logit = logf(config.confidence / (1.0f - config.confidence));
+    for (const YoloHead &head : heads) {
+        size_t cells    = head.height * head.width;
+        size_t channels = YOLO_BOX_SIZE + head.classes;
+        const float *image = head.data + b * head.anchors * channels * cells;
+        for (size_t a = 0; a < head.anchors; a++) {
+            const float *box = image + a * channels * cells;
+            s.cells.clear();
+#ifdef DETECTIONS_X86
+            if (isa == DETECTION_AVX512)
+                FilterYoloPlaneAvx512(box + 4 * cells, cells, logit, s.cells);
+            else if (isa == DETECTION_AVX2)
+                FilterYoloPlaneAvx2(box + 4 * cells, cells, logit, s.cells);
+            else
+#endif
+                FilterYoloPlane(box + 4 * cells, cells, logit, 0, s.cells);
+
+            for (unsigned cell : s.cells) {
+                // the class scores of a cell are one plane apart
+                const float *classes = box + YOLO_BOX_SIZE * cells + cell;
+                int label            = 0;
+                for (size_t c = 1; c < head.classes; c++)
+                    if (classes[c * cells] > classes[label * cells])
+                        label = (int)c;
+                float score = YoloSigmoid(box[4 * cells + cell]) * YoloSigmoid(classes[label * cells]);
+                if (score < config.confidence)
+                    continue;
+                s.tx.push_back(box[cell]);
+                s.ty.push_back(box[cells + cell]);
+                s.tw.push_back(box[2 * cells + cell]);
+                s.th.push_back(box[3 * cells + cell]);
+                s.cx.push_back((float)(cell % head.width));
+                s.cy.push_back((float)(cell / head.width));
+                s.aw.push_back(head.anchorSizes[2 * a] / config.inputWidth);
+                s.ah.push_back(head.anchorSizes[2 * a + 1] / config.inputHeight);
+                s.sx.push_back(1.0f / head.width);
+                s.sy.push_back(1.0f / head.height);
+                s.score.push_back(score);
+                s.label.push_back(label);
+            }
+        }
+    }
+}
+
+// Detections of the raw heads of a batch, per image: objectness filter, box decoding and greedy
+// non-maximum suppression per class. The candidates are sorted by score into contiguous arrays
+// once, so every suppression pass streams through them; overlap is tested 8 boxes at a time.
+// Coordinates are relative to the input like those of ParseDetections().
+inline void DecodeYolo(const std::vector<YoloHead> &heads,
+                       const YoloConfig &config,
+                       DetectionBatch &detections,
+                       YoloScratch &s,
+                       DetectionIsa isa = BestDetectionIsa()) {
+    detections.count = 0;
+    if (heads.empty())
+        return;
+    for (size_t b = 0; b < heads[0].batch; b++) {
+        s.clear();
+        CollectYoloCandidates(heads, b, config, s, isa);
+        size_t count = s.score.size();
+        if (count == 0)
+            continue;
+
+        s.x1.resize(count), s.y1.resize(count), s.x2.resize(count), s.y2.resize(count);
+        size_t decoded = 0;
+#ifdef DETECTIONS_X86
+        if (isa != DETECTION_SCALAR)
+            decoded = DecodeYoloBoxesAvx2(s, count);
+#endif
+        DecodeYoloBoxes(s, decoded, count);
+
+        // highest score first, ties in candidate order so every instruction set keeps the same boxes
+        s.order.resize(count);
+        for (size_t i = 0; i < count; i++)
+            s.order[i] = (unsigned)i;
+        std::sort(s.order.begin(), s.order.end(), [&](unsigned l, unsigned r) {
+            return s.score[l] > s.score[r] || (s.score[l] == s.score[r] && l < r);
+        });
+        s.bx1.resize(count), s.by1.resize(count), s.bx2.resize(count), s.by2.resize(count);
+        s.area.resize(count), s.blabel.resize(count);
+        s.suppressed.assign(count, 0);
+        for (size_t i = 0; i < count; i++) {
+            unsigned k  = s.order[i];
+            s.bx1[i]    = s.x1[k];
+            s.by1[i]    = s.y1[k];
+            s.bx2[i]    = s.x2[k];
+            s.by2[i]    = s.y2[k];
+            s.area[i]   = (s.x2[k] - s.x1[k]) * (s.y2[k] - s.y1[k]);
+            s.blabel[i] = s.label[k];
+        }
+
+        detections.reserve(detections.count + count);
+        for (size_t i = 0; i < count; i++) {
+            if (s.suppressed[i])
+                continue;
+            size_t j = i + 1;
+#ifdef DETECTIONS_X86
+            if (isa != DETECTION_SCALAR)
+                j = SuppressYoloAvx2(s, i, j, count, config.iou);
+#endif
+            SuppressYolo(s, i, j, count, config.iou);
+
+            size_t n                 = detections.count++;
+            unsigned k               = s.order[i];
+            detections.image_id[n]   = (int)b;
+            detections.label[n]      = s.label[k];
+            detections.confidence[n] = s.score[k];
+            detections.x_min[n]      = s.x1[k];
+            detections.y_min[n]      = s.y1[k];
+            detections.x_max[n]      = s.x2[k];
+            detections.y_max[n]      = s.y2[k];
+        }
+    }
+}
+
+#endif //EXAMPLES_YOLO_H_